@@ -5,33 +5,78 @@
  */
 #include "libvote.hh"
 
+#include <algorithm>
 #include <cassert>
 
 namespace vote::algorithm {
-static bool count_votes(struct ballot &ballot) {
-	for (struct participant participant : ballot.participants) {
-		usize rank;
-		i32   id;
-
-		for (rank = 0; rank < participant.votes.size(); ++rank) {
-			id = participant.votes[rank];
-
-			auto it = find_candidate(ballot, id);
-			if (it != ballot.candidates.end() && !it->eliminated) {
-				++it->votes;
-				break;
-			}
+static bool count_votes(struct ballot          &ballot,
+                        std::vector<i32> const &eliminated) {
+	std::vector<usize> votes;
+
+	/* chaque participant vote pour sa glace preferee parmi celles qui ne sont
+	 * pas encore eliminees */
+	count_first(ballot, eliminated, votes);
 
-			/* si le candidat est elimine, on prend le prochain dans
-			 * le classement */
+	for (struct candidate &candidate : ballot.candidates) {
+		if (!candidate.eliminated) {
+			candidate.votes += votes[candidate.id];
 		}
 	}
 
 	return true;
 }
 
+/**
+ * Elimine d'un coup les glaces en dernieres positions dont la somme des voix
+ * reste strictement inferieure aux voix de la glace suivante : meme en
+ * recuperant tous ces reports, aucune d'entre elles ne pourrait la depasser.
+ * Si aucun groupe de plus d'une glace ne convient, seule la derniere glace est
+ * eliminee, comme dans un tour classique.
+ *
+ * @param ballot      Le vote, avec les glaces triees par ordre croissant des
+ *                    voix
+ * @param eliminated  Identifiants des glaces eliminees
+ * @return  Le nombre de glaces eliminees
+ */
+static usize eliminate_defeated(struct ballot    &ballot,
+                                std::vector<i32> &eliminated) {
+	std::vector<struct candidate *> active;
+	usize                           sum;
+	usize                           count;
+	usize                           i;
+
+	for (struct candidate &candidate : ballot.candidates) {
+		if (!candidate.eliminated) {
+			active.push_back(&candidate);
+		}
+	}
+
+	if (active.empty()) {
+		return 0;
+	}
+
+	/* on cherche le plus grand groupe de glaces en bas du classement qui ne
+	 * peut plus rattraper la glace qui le suit */
+	count = 1;
+	sum   = 0;
+	for (i = 0; i + 1 < active.size(); ++i) {
+		sum += active[i]->votes;
+		if (sum < active[i + 1]->votes) {
+			count = i + 1;
+		}
+	}
+
+	for (i = 0; i < count; ++i) {
+		active[i]->eliminated = true;
+		eliminated.push_back(active[i]->id);
+	}
+
+	return count;
+}
+
 bool instant_runoff(struct ballot &ballot) {
-	double frac;
+	std::vector<i32> eliminated;
+	double           frac;
 
 	ballot.round = 0;
 
@@ -41,10 +86,21 @@ bool instant_runoff(struct ballot &ballot) {
 		}
 
 		++ballot.round;
+		eliminated.clear();
 
 		/* si on a deja compte les votes ce tour et il n'y avait pas de
 		 * majorite absolue, on elimine la glace en derniere position */
-		if (ballot.round > 1) {
+		if (ballot.round > 1 && ballot.batch) {
+			usize count = eliminate_defeated(ballot, eliminated);
+
+			if (count > 1) {
+				ballot.collapsed.push_back(ballot.round);
+			}
+			if (count > 1 && ballot.verbose) {
+				std::cerr << "Round " << ballot.round << ": " << count
+						  << " candidates eliminated at once" << std::endl;
+			}
+		} else if (ballot.round > 1) {
 			/* on trouve la premiere glace qui n'est pas eliminee dans le
 			 * vecteur deja trie par ordre croissant de nombre de votes */
 			auto it = std::find_if(
@@ -53,12 +109,13 @@ bool instant_runoff(struct ballot &ballot) {
 
 			if (it != ballot.candidates.end()) {
 				it->eliminated = true;
+				eliminated.push_back(it->id);
 			}
 		}
 
 		/* on commence le tour */
 		begin_round(ballot);
-		if (!count_votes(ballot)) {
+		if (!count_votes(ballot, eliminated)) {
 			return false;
 		}
 
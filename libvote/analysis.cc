@@ -0,0 +1,139 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Analyse de la robustesse des resultats par reechantillonnage
+ */
+#include "libvote.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+
+namespace vote::analysis {
+/**
+ * Travail d'un fil d'execution : il prend les echantillons un par un dans le
+ * compteur partage jusqu'a ce qu'il n'en reste plus. Le nombre de
+ * participants tient sur 32 bits, verifie par bootstrap().
+ */
+static void run_samples(struct ballot const &ballot, system system,
+                        usize samples, u64 seed, std::atomic<usize> &next,
+                        std::atomic<bool> &failed, std::vector<usize> &wins) {
+	usize                              count = ballot.roll->participants.size();
+	struct ballot                      local;
+	std::uniform_int_distribution<u32> pick(0, (u32)(count - 1));
+	usize                              n;
+	usize                              i;
+
+	local.roll  = ballot.roll;
+	local.ranks = ballot.ranks;
+	local.sample.resize(count);
+	local.batch    = ballot.batch;
+	local.verbose  = false;
+	local.observer = nullptr;
+
+	while (!failed && (n = next++) < samples) {
+		/* chaque echantillon a son propre generateur pour que le resultat
+		 * ne depende pas de la repartition entre les fils d'execution */
+		std::seed_seq seq{(u32)seed, (u32)(seed >> 32), (u32)n,
+		                  (u32)((u64)n >> 32)};
+		std::mt19937  rng(seq);
+
+		for (i = 0; i < local.sample.size(); ++i) {
+			local.sample[i] = pick(rng);
+		}
+
+		local.candidates = ballot.candidates;
+		local.winners.clear();
+		local.collapsed.clear();
+		local.transfers.clear();
+		local.round = 1;
+
+		if (!system(local)) {
+			failed = true;
+			return;
+		}
+
+		if (!local.winners.empty()) {
+			++wins[local.winners[0] - 1];
+		}
+	}
+}
+
+bool bootstrap(struct ballot const &ballot, system system, usize samples,
+               u64 seed, usize jobs, std::vector<usize> &wins) {
+	std::vector<std::vector<usize>> results;
+	std::vector<std::thread>        threads;
+	std::atomic<usize>              next(0);
+	std::atomic<bool>               failed(false);
+	usize                           i;
+	usize                           j;
+
+	wins.assign(ballot.candidates.size(), 0);
+
+	/* les indices des echantillons sont sur 32 bits */
+	if (ballot.roll->participants.empty() ||
+	    ballot.roll->participants.size() > UINT32_MAX) {
+		return false;
+	}
+
+	if (jobs == 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+	jobs = std::min(jobs, std::max<usize>(samples, 1));
+
+	results.assign(jobs, std::vector<usize>(wins.size(), 0));
+
+	for (i = 0; i < jobs; ++i) {
+		threads.emplace_back(run_samples, std::cref(ballot), system, samples,
+		                     seed, std::ref(next), std::ref(failed),
+		                     std::ref(results[i]));
+	}
+
+	for (i = 0; i < jobs; ++i) {
+		threads[i].join();
+
+		for (j = 0; j < wins.size(); ++j) {
+			wins[j] += results[i][j];
+		}
+	}
+
+	return !failed;
+}
+
+bool withdraw(struct ballot const &ballot, system system,
+              std::vector<i32> const &withdrawn, struct ballot &result) {
+	usize remaining;
+
+	for (i32 id : withdrawn) {
+		if (id < 1 || (usize)id > ballot.candidates.size()) {
+			return false;
+		}
+	}
+
+	/* la copie partage les participants et les decomptes */
+	result = ballot;
+	result.winners.clear();
+	result.collapsed.clear();
+	result.transfers.clear();
+	result.round    = 1;
+	result.verbose  = false;
+	result.observer = nullptr;
+
+	remaining = 0;
+	for (struct candidate &candidate : result.candidates) {
+		candidate.votes      = 0;
+		candidate.last_votes = 0;
+		candidate.eliminated =
+			std::find(withdrawn.begin(), withdrawn.end(), candidate.id) !=
+			withdrawn.end();
+
+		remaining += !candidate.eliminated;
+	}
+
+	if (remaining == 0) {
+		return false;
+	}
+
+	return system(result);
+}
+} // namespace vote::analysis
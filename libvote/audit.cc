@@ -0,0 +1,89 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Audit par sondage des bulletins (methode BRAVO)
+ */
+#include "libvote.hh"
+
+#include <algorithm>
+
+namespace vote::audit {
+u64 draw(u64 seed, u64 n, u64 participants) {
+	u64 z = seed + (n + 1) * 0x9e3779b97f4a7c15;
+
+	/* SplitMix64 : chaque rang donne un nombre independant des autres */
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	z = z ^ (z >> 31);
+
+	/* ramene dans [0, participants) sans division */
+	return (u64)(((unsigned __int128)z * participants) >> 64);
+}
+
+bool begin(std::vector<usize> const &votes, struct ballot_polling &polling) {
+	usize id;
+
+	polling.winner  = 0;
+	polling.sampled = 0;
+	polling.shares.assign(votes.size(), 0);
+	polling.ratios.assign(votes.size(), 1);
+
+	for (id = 1; id < votes.size(); ++id) {
+		if (polling.winner == 0 || votes[id] > votes[polling.winner]) {
+			polling.winner = id;
+		}
+	}
+
+	if (polling.winner == 0 || votes[polling.winner] == 0) {
+		return false;
+	}
+
+	for (id = 1; id < votes.size(); ++id) {
+		usize winner = votes[polling.winner];
+
+		if ((i32)id == polling.winner) {
+			continue;
+		}
+
+		/* une egalite ne peut pas etre confirmee par un sondage */
+		if (votes[id] == winner) {
+			return false;
+		}
+
+		polling.shares[id] = (double)winner / (double)(winner + votes[id]);
+	}
+
+	return true;
+}
+
+void confirm(struct ballot_polling &polling, i32 id) {
+	usize i;
+
+	++polling.sampled;
+
+	/* un bulletin pour le gagnant rapproche chaque test de sa conclusion,
+	 * un bulletin pour une glace perdante l'eloigne seulement du test face a
+	 * cette glace */
+	if (id == polling.winner) {
+		for (i = 1; i < polling.ratios.size(); ++i) {
+			if ((i32)i != polling.winner) {
+				polling.ratios[i] *= 2 * polling.shares[i];
+			}
+		}
+	} else if (id > 0 && (usize)id < polling.ratios.size()) {
+		polling.ratios[id] *= 2 * (1 - polling.shares[id]);
+	}
+}
+
+double get_risk(struct ballot_polling const &polling) {
+	double risk = 0;
+	usize  i;
+
+	for (i = 1; i < polling.ratios.size(); ++i) {
+		if ((i32)i != polling.winner) {
+			risk = std::max(risk, std::min(1.0, 1 / polling.ratios[i]));
+		}
+	}
+
+	return risk;
+}
+} // namespace vote::audit
@@ -0,0 +1,572 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Cache sur disque des votes et des resultats
+ */
+#include "libvote.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vote {
+ballot_file::ballot_file()
+	: map(nullptr), size(0), key(0), participants(0), length(0), width(0),
+	  vote_counts(nullptr), index(nullptr), ids(nullptr), id_count(0) {}
+
+ballot_file::~ballot_file() {
+	if (map != nullptr) {
+		munmap((void *)map, size);
+	}
+}
+
+namespace cache {
+/**
+ * Premiers octets de tous les fichiers du cache, "VOTE" en petit boutiste : un
+ * fichier ecrit sur une machine d'un autre boutisme sera ignore
+ */
+static u32 const magic = 0x45544f56;
+
+/**
+ * Version du format des fichiers, a incrementer a chaque changement
+ */
+static u32 const version = 3;
+
+/**
+ * Nombre de participants entre deux positions de l'index d'un vote
+ * enregistre, voir save_ballot()
+ */
+static usize const index_step = 4096;
+
+/**
+ * Contenu d'un fichier du cache
+ */
+enum kind : u32 { ballot_kind = 'B', result_kind = 'R' };
+
+template <typename T> static void write_value(std::ostream &stream, T value) {
+	stream.write((char const *)&value, sizeof(value));
+}
+
+template <typename T> static bool read_value(std::istream &stream, T &value) {
+	return (bool)stream.read((char *)&value, sizeof(value));
+}
+
+static void write_bytes(std::ostream &stream, void const *data, usize size) {
+	write_value<u64>(stream, size);
+	stream.write((char const *)data, size);
+}
+
+/**
+ * Lit un bloc ecrit avec write_bytes(), en refusant un bloc plus long que ce
+ * qu'il reste du fichier (fichier tronque ou abime)
+ */
+template <typename T>
+static bool read_bytes(std::istream &stream, usize remaining,
+                       std::vector<T> &data) {
+	u64 size;
+
+	if (!read_value(stream, size) || size > remaining ||
+	    size % sizeof(T) != 0) {
+		return false;
+	}
+
+	data.resize(size / sizeof(T));
+	return (bool)stream.read((char *)data.data(), size);
+}
+
+static void write_header(std::ostream &stream, enum kind kind, u64 key) {
+	write_value(stream, magic);
+	write_value(stream, version);
+	write_value<u32>(stream, kind);
+	write_value(stream, key);
+}
+
+/**
+ * Ouvre un fichier du cache et verifie son en-tete
+ *
+ * @param stream  Le flux du fichier
+ * @param path    Chemin du fichier
+ * @param kind    Contenu attendu
+ * @param key     Empreinte attendue
+ * @param size    Taille du fichier
+ * @return  Valeur booleenne indiquant que le fichier peut etre lu
+ */
+static bool open_entry(std::ifstream &stream, std::string const &path,
+                       enum kind kind, u64 key, usize &size) {
+	u32 header[3];
+	u64 entry_key;
+
+	stream.open(path, std::ios::binary | std::ios::ate);
+	if (!stream) {
+		return false;
+	}
+
+	size = stream.tellg();
+	stream.seekg(0);
+
+	return read_value(stream, header) && header[0] == magic &&
+	       header[1] == version && header[2] == kind &&
+	       read_value(stream, entry_key) && entry_key == key;
+}
+
+/**
+ * Ecrit un fichier du cache de facon atomique : il est ecrit a cote puis
+ * renomme, pour qu'un autre processus ne lise jamais un fichier a moitie ecrit
+ *
+ * @param path   Chemin du fichier
+ * @param write  Ecrit le contenu dans le flux
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+template <typename F>
+static bool write_entry(std::string const &path, F const &write) {
+	std::string   temporary = path + ".tmp" + std::to_string(getpid());
+	std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+
+	if (!stream) {
+		return false;
+	}
+
+	write(stream);
+	stream.close();
+
+	if (!stream || std::rename(temporary.c_str(), path.c_str()) != 0) {
+		std::remove(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+u64 hash(void const *data, usize size, u64 seed) {
+	u64 const m     = 0xc6a4a7935bd1e995;
+	u32 const r     = 47;
+	u8 const *bytes = (u8 const *)data;
+	u8 const *end   = bytes + size / 8 * 8;
+	u64       h     = seed ^ (size * m);
+	u64       k;
+	usize     i;
+
+	for (; bytes != end; bytes += 8) {
+		std::memcpy(&k, bytes, sizeof(k));
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	if (size % 8 != 0) {
+		for (i = size % 8; i-- > 0;) {
+			h ^= (u64)bytes[i] << (8 * i);
+		}
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
+std::string get_path(std::string const &directory, u64 key, char const *kind) {
+	char name[17];
+
+	std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+
+	return directory + "/" + name + "." + kind;
+}
+
+template <typename T>
+static void write_ids(std::ostream &stream, std::vector<T> const &ids) {
+	write_bytes(stream, ids.data(), ids.size() * sizeof(T));
+}
+
+template <typename T>
+static bool read_ids(std::istream &stream, usize remaining,
+                     std::vector<i32> &votes) {
+	std::vector<T> ids;
+
+	if (!read_bytes(stream, remaining, ids)) {
+		return false;
+	}
+
+	votes.assign(ids.begin(), ids.end());
+	return true;
+}
+
+bool save_ballot(std::string const &path, u64 key,
+                 struct ballot const &ballot) {
+	return write_entry(path, [&](std::ostream &stream) {
+		struct ranks const &ranks = *ballot.ranks;
+		std::vector<u32>    vote_counts;
+		std::vector<u64>    index;
+		std::vector<usize>  first_votes;
+		std::vector<u32>    lines;
+		u64                 first_vote = 0;
+
+		write_header(stream, ballot_kind, key);
+
+		write_value<u64>(stream, ballot.candidates.size());
+		for (struct candidate const &candidate : ballot.candidates) {
+			write_value(stream, candidate.id);
+			write_bytes(stream, candidate.name.data(), candidate.name.size());
+		}
+
+		/* les longueurs des classements ne sont utiles que si elles ne sont
+		 * pas toutes les memes. L'index donne la position du classement d'un
+		 * participant sur index_step, pour y acceder sans additionner toutes
+		 * les longueurs precedentes. */
+		if (ranks.length == 0) {
+			for (struct participant const &p : ballot.roll->participants) {
+				if (vote_counts.size() % index_step == 0) {
+					index.push_back(first_vote);
+				}
+
+				vote_counts.push_back(p.vote_count);
+				first_vote += p.vote_count;
+			}
+		}
+
+		/* le premier tour, pour un audit qui ne lirait pas tout le vote */
+		tally::count_first(ballot, first_votes);
+
+		/* les lignes de l'entree, pour signaler a quelle ligne un autre
+		 * systeme de votes refuse un participant (0 si elle est inconnue) */
+		for (struct participant const &p : ballot.roll->participants) {
+			lines.push_back(p.line);
+		}
+
+		write_value<u64>(stream, ballot.roll->participants.size());
+		write_value(stream, ranks.length);
+		write_value(stream, ranks.width);
+		write_bytes(stream, vote_counts.data(),
+		            vote_counts.size() * sizeof(u32));
+		write_bytes(stream, index.data(), index.size() * sizeof(u64));
+		write_bytes(stream, first_votes.data(),
+		            first_votes.size() * sizeof(usize));
+		write_bytes(stream, lines.data(), lines.size() * sizeof(u32));
+
+		/* les classements compacts sont ecrits comme des identifiants sur
+		 * 1 octet */
+		if (ranks.word != 0) {
+			write_ids(stream, tally::unpack(*ballot.roll, ranks));
+		} else if (ranks.width == 1) {
+			write_ids(stream, ranks.ids8);
+		} else if (ranks.width == 2) {
+			write_ids(stream, ranks.ids16);
+		} else {
+			write_ids(stream, ranks.ids32);
+		}
+	});
+}
+
+bool load_ballot(std::string const &path, u64 key,
+                 std::vector<struct candidate> &candidates, struct roll &roll) {
+	std::ifstream      stream;
+	std::vector<u32>   vote_counts;
+	std::vector<u64>   index;
+	std::vector<usize> first_votes;
+	std::vector<u32>   lines;
+	usize              size;
+	u64              candidate_count;
+	u64              participant_count;
+	u32              length;
+	u32              width;
+	usize            first_vote;
+	usize            i;
+	bool             valid;
+
+	if (!open_entry(stream, path, ballot_kind, key, size) ||
+	    !read_value(stream, candidate_count) || candidate_count > size) {
+		return false;
+	}
+
+	candidates.resize(candidate_count);
+	for (struct candidate &candidate : candidates) {
+		std::vector<char> name;
+
+		if (!read_value(stream, candidate.id) ||
+		    !read_bytes(stream, size, name)) {
+			return false;
+		}
+
+		candidate.name.assign(name.begin(), name.end());
+		candidate.votes      = 0;
+		candidate.last_votes = 0;
+		candidate.eliminated = false;
+	}
+
+	if (!read_value(stream, participant_count) || participant_count > size ||
+	    !read_value(stream, length) || !read_value(stream, width) ||
+	    !read_bytes(stream, size, vote_counts) ||
+	    !read_bytes(stream, size, index) ||
+	    !read_bytes(stream, size, first_votes) ||
+	    !read_bytes(stream, size, lines) ||
+	    (!lines.empty() && lines.size() != participant_count)) {
+		return false;
+	}
+
+	if (width == 1) {
+		valid = read_ids<u8>(stream, size, roll.votes);
+	} else if (width == 2) {
+		valid = read_ids<u16>(stream, size, roll.votes);
+	} else {
+		valid = read_ids<u32>(stream, size, roll.votes);
+	}
+
+	if (!valid || (length == 0 && vote_counts.size() != participant_count) ||
+	    (length != 0 && roll.votes.size() != participant_count * length)) {
+		return false;
+	}
+
+	/* les identifiants eux-memes sont verifies par get_ballot() */
+	roll.participants.resize(participant_count);
+	roll.anonymous = true;
+
+	for (i = 0, first_vote = 0; i < participant_count; ++i) {
+		struct participant &participant = roll.participants[i];
+
+		participant.name            = 0;
+		participant.last_name_size  = 0;
+		participant.first_name_size = 0;
+		participant.first_vote      = first_vote;
+		participant.vote_count      = length == 0 ? vote_counts[i] : length;
+		participant.line            = lines.empty() ? 0 : lines[i];
+
+		first_vote += participant.vote_count;
+	}
+
+	return first_vote == roll.votes.size();
+}
+
+/**
+ * Position de lecture dans un fichier projete en memoire
+ */
+struct cursor {
+	u8 const *data;
+	usize     size;
+	usize     position;
+};
+
+template <typename T> static bool take_value(struct cursor &cursor, T &value) {
+	if (cursor.size - cursor.position < sizeof(T)) {
+		return false;
+	}
+
+	std::memcpy(&value, cursor.data + cursor.position, sizeof(T));
+	cursor.position += sizeof(T);
+	return true;
+}
+
+/**
+ * Trouve un bloc ecrit avec write_bytes() sans le copier
+ *
+ * @param cursor   La position de lecture, deplacee apres le bloc
+ * @param element  Taille d'un element du bloc
+ * @param data     Debut du bloc
+ * @param count    Nombre d'elements du bloc
+ * @return  Valeur booleenne indiquant que le bloc tient dans le fichier
+ */
+static bool take_bytes(struct cursor &cursor, usize element, u8 const *&data,
+                       usize &count) {
+	u64 size;
+
+	if (!take_value(cursor, size) || size > cursor.size - cursor.position ||
+	    size % element != 0) {
+		return false;
+	}
+
+	data  = cursor.data + cursor.position;
+	count = size / element;
+	cursor.position += size;
+	return true;
+}
+
+/**
+ * Lit l'en-tete et les blocs d'un vote projete en memoire
+ */
+static bool map_ballot(struct cursor &cursor, struct ballot_file &file) {
+	u32       header[3];
+	u64       candidate_count;
+	u8 const *data;
+	usize     count;
+	u8 const *lines;
+	usize     index_count;
+	usize     line_count;
+	usize     id_count;
+
+	if (!take_value(cursor, header) || header[0] != magic ||
+	    header[1] != version || header[2] != ballot_kind ||
+	    !take_value(cursor, file.key) ||
+	    !take_value(cursor, candidate_count) ||
+	    candidate_count > cursor.size) {
+		return false;
+	}
+
+	file.candidates.resize(candidate_count);
+	for (struct candidate &candidate : file.candidates) {
+		if (!take_value(cursor, candidate.id) ||
+		    !take_bytes(cursor, 1, data, count)) {
+			return false;
+		}
+
+		candidate.name.assign((char const *)data, count);
+		candidate.votes      = 0;
+		candidate.last_votes = 0;
+		candidate.eliminated = false;
+	}
+
+	if (!take_value(cursor, file.participants) ||
+	    !take_value(cursor, file.length) || !take_value(cursor, file.width) ||
+	    (file.width != 1 && file.width != 2 && file.width != 4) ||
+	    !take_bytes(cursor, sizeof(u32), file.vote_counts, count) ||
+	    !take_bytes(cursor, sizeof(u64), file.index, index_count) ||
+	    (file.length == 0 &&
+	     (count != file.participants ||
+	      index_count != (file.participants + index_step - 1) / index_step)) ||
+	    !take_bytes(cursor, sizeof(usize), data, count) ||
+	    count != candidate_count + 1 ||
+	    !take_bytes(cursor, sizeof(u32), lines, line_count) ||
+	    (line_count != 0 && line_count != file.participants) ||
+	    !take_bytes(cursor, file.width, file.ids, id_count) ||
+	    (file.length != 0 && id_count != file.participants * file.length)) {
+		return false;
+	}
+
+	file.first_votes.resize(count);
+	std::memcpy(file.first_votes.data(), data, count * sizeof(usize));
+	file.id_count = id_count;
+
+	return true;
+}
+
+bool open_ballot(std::string const &path, struct ballot_file &file) {
+	struct stat   status;
+	struct cursor cursor;
+	void         *map;
+	int           fd;
+
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	if (fstat(fd, &status) != 0 || status.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	/* la projection reste valable apres la fermeture du descripteur */
+	map = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+
+	file.map  = map;
+	file.size = status.st_size;
+
+	/* les participants sont lus au hasard, pas dans l'ordre */
+	madvise(map, file.size, MADV_RANDOM);
+
+	cursor.data     = (u8 const *)map;
+	cursor.size     = file.size;
+	cursor.position = 0;
+
+	return map_ballot(cursor, file);
+}
+
+/**
+ * Lit un identifiant de glace sur <code>T</code> dans un fichier projete
+ */
+template <typename T> static i32 read_id(u8 const *ids, usize position) {
+	T id;
+
+	std::memcpy(&id, ids + position * sizeof(T), sizeof(T));
+	return (i32)id;
+}
+
+bool get_ranking(struct ballot_file const &file, u64 participant,
+                 std::vector<i32> &ranking) {
+	u64   first_vote;
+	u32   count;
+	usize i;
+
+	if (participant >= file.participants) {
+		return false;
+	}
+
+	if (file.length != 0) {
+		first_vote = participant * file.length;
+		count      = file.length;
+	} else {
+		/* au plus index_step longueurs a additionner depuis l'index */
+		std::memcpy(&first_vote,
+		            file.index + participant / index_step * sizeof(u64),
+		            sizeof(u64));
+
+		for (i = participant - participant % index_step; i < participant;
+		     ++i) {
+			std::memcpy(&count, file.vote_counts + i * sizeof(u32),
+			            sizeof(u32));
+			first_vote += count;
+		}
+
+		std::memcpy(&count, file.vote_counts + participant * sizeof(u32),
+		            sizeof(u32));
+	}
+
+	if (first_vote + count > file.id_count) {
+		return false;
+	}
+
+	ranking.resize(count);
+	for (i = 0; i < count; ++i) {
+		if (file.width == 1) {
+			ranking[i] = read_id<u8>(file.ids, first_vote + i);
+		} else if (file.width == 2) {
+			ranking[i] = read_id<u16>(file.ids, first_vote + i);
+		} else {
+			ranking[i] = read_id<u32>(file.ids, first_vote + i);
+		}
+	}
+
+	return true;
+}
+
+bool save_result(std::string const &path, u64 key, std::string const &rounds,
+                 std::string const &output) {
+	return write_entry(path, [&](std::ostream &stream) {
+		write_header(stream, result_kind, key);
+		write_bytes(stream, rounds.data(), rounds.size());
+		write_bytes(stream, output.data(), output.size());
+	});
+}
+
+bool load_result(std::string const &path, u64 key, std::string &rounds,
+                 std::string &output) {
+	std::ifstream     stream;
+	std::vector<char> data;
+	usize             size;
+
+	if (!open_entry(stream, path, result_kind, key, size) ||
+	    !read_bytes(stream, size, data)) {
+		return false;
+	}
+	rounds.assign(data.begin(), data.end());
+
+	if (!read_bytes(stream, size, data)) {
+		return false;
+	}
+	output.assign(data.begin(), data.end());
+
+	return true;
+}
+} // namespace cache
+} // namespace vote
@@ -0,0 +1,289 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Implementation de l'interface C de la bibliotheque
+ */
+#include "libvote.h"
+#include "libvote.hh"
+
+#include <algorithm>
+#include <exception>
+
+/**
+ * Vote de l'interface C : un vote initialise avec get_ballot(), copie a
+ * chaque vote_run()
+ */
+struct vote_ballot {
+	struct vote::ballot ballot;
+	/**
+	 * Indique qu'un participant classe une glace deux fois, ce que seul le
+	 * vote majoritaire accepte
+	 */
+	bool repeated;
+};
+
+/**
+ * Resultat de l'interface C
+ */
+struct vote_result {
+	/**
+	 * Nombre de glaces de chaque tour
+	 */
+	size_t candidate_count;
+	/**
+	 * Les glaces de tous les tours, mises bout a bout
+	 */
+	std::vector<vote_tally> tallies;
+	/**
+	 * Glaces gagnantes
+	 */
+	std::vector<int32_t> winners;
+	/**
+	 * Reports de voix de tous les tours
+	 */
+	std::vector<vote_transfer> transfers;
+};
+
+/**
+ * Garde l'etat des glaces a la fin d'un tour, dans l'ordre des identifiants
+ * (les systemes de votes trient <code>ballot.candidates</code> sur place)
+ */
+static void record_round(struct vote::ballot const &ballot, void *data) {
+	struct vote_result *result = (struct vote_result *)data;
+	usize               first  = result->tallies.size();
+
+	for (struct vote::candidate const &candidate : ballot.candidates) {
+		vote_tally tally;
+
+		tally.id         = candidate.id;
+		tally.eliminated = candidate.eliminated;
+		tally.votes      = candidate.votes;
+		tally.last_votes = candidate.last_votes;
+
+		result->tallies.push_back(tally);
+	}
+
+	std::sort(result->tallies.begin() + first, result->tallies.end(),
+	          [](vote_tally const &lhs, vote_tally const &rhs) {
+				  return lhs.id < rhs.id;
+			  });
+}
+
+extern "C" {
+unsigned vote_api_version(void) { return VOTE_API_VERSION; }
+
+vote_status vote_ballot_create(char const *const *names,
+                               size_t candidate_count, int32_t const *ids,
+                               uint32_t const *lengths,
+                               size_t participant_count, vote_ballot **ballot) {
+	std::vector<struct vote::candidate> candidates;
+	struct vote::roll                   roll;
+	std::vector<u64>                    seen;
+	bool                                repeated;
+	usize                               vote;
+	usize                               i;
+
+	if (ballot == NULL || names == NULL || candidate_count == 0 ||
+	    candidate_count > INT32_MAX ||
+	    (participant_count > 0 && (ids == NULL || lengths == NULL))) {
+		return VOTE_ERROR_ARGUMENT;
+	}
+
+	*ballot = NULL;
+
+	try {
+		for (i = 0; i < candidate_count; ++i) {
+			struct vote::candidate candidate;
+
+			if (names[i] == NULL) {
+				return VOTE_ERROR_ARGUMENT;
+			}
+
+			candidate.id   = i + 1;
+			candidate.name = names[i];
+			candidates.push_back(candidate);
+		}
+
+		roll.anonymous = true;
+		roll.participants.resize(participant_count);
+
+		for (i = 0, vote = 0; i < participant_count; ++i) {
+			struct vote::participant &participant = roll.participants[i];
+
+			if (lengths[i] == 0) {
+				return VOTE_ERROR_INVALID;
+			}
+
+			participant.name            = 0;
+			participant.last_name_size  = 0;
+			participant.first_name_size = 0;
+			participant.first_vote      = vote;
+			participant.vote_count      = lengths[i];
+			participant.line            = 0;
+
+			vote += lengths[i];
+		}
+
+		roll.votes.assign(ids, ids + vote);
+
+		/* le systeme n'est connu qu'a vote_run() : les glaces repetees sont
+		 * notees ici et refusees la-bas, sauf pour le vote majoritaire */
+		seen.assign(candidate_count / 64 + 1, 0);
+		repeated = false;
+		for (i = 0; i < participant_count && !repeated; ++i) {
+			i32 const *ranking = ids + roll.participants[i].first_vote;
+
+			repeated = vote::tally::find_invalid(ranking, lengths[i],
+			                                     candidate_count,
+			                                     seen.data()) < lengths[i];
+		}
+
+		std::unique_ptr<vote_ballot> created(new vote_ballot());
+		if (!vote::get_ballot(std::move(candidates), std::move(roll),
+		                      created->ballot)) {
+			return VOTE_ERROR_INVALID;
+		}
+
+		created->ballot.verbose = false;
+		created->repeated       = repeated;
+		*ballot                 = created.release();
+	} catch (std::exception const &) {
+		/* seules les allocations peuvent echouer */
+		return VOTE_ERROR_MEMORY;
+	}
+
+	return VOTE_OK;
+}
+
+void vote_ballot_free(vote_ballot *ballot) { delete ballot; }
+
+vote_status vote_run(vote_ballot const *ballot, vote_system system,
+                     unsigned flags, vote_result **result) {
+	vote::analysis::system run;
+
+	if (ballot == NULL || result == NULL) {
+		return VOTE_ERROR_ARGUMENT;
+	}
+
+	*result = NULL;
+
+	switch (system) {
+	case VOTE_TWO_ROUND:
+		run = vote::algorithm::two_round;
+		break;
+	case VOTE_INSTANT_RUNOFF:
+		run = vote::algorithm::instant_runoff;
+		break;
+	case VOTE_RANKED:
+		run = vote::algorithm::ranked;
+		break;
+	default:
+		return VOTE_ERROR_ARGUMENT;
+	}
+
+	if (ballot->repeated && system != VOTE_TWO_ROUND) {
+		return VOTE_ERROR_INVALID;
+	}
+
+	try {
+		/* la copie partage les participants et les classements */
+		struct vote::ballot          local = ballot->ballot;
+		std::unique_ptr<vote_result> created(new vote_result());
+
+		created->candidate_count = local.candidates.size();
+
+		local.batch         = (flags & VOTE_FLAG_BATCH) != 0;
+		local.verbose       = false;
+		local.observer      = record_round;
+		local.observer_data = created.get();
+
+		if (!run(local)) {
+			return VOTE_ERROR_FAILED;
+		}
+
+		created->winners.assign(local.winners.begin(), local.winners.end());
+		for (struct vote::transfer const &transfer : local.transfers) {
+			created->transfers.push_back(
+				{transfer.round, transfer.from, transfer.to, transfer.votes});
+		}
+		*result = created.release();
+	} catch (std::exception const &) {
+		/* seules les allocations peuvent echouer */
+		return VOTE_ERROR_MEMORY;
+	}
+
+	return VOTE_OK;
+}
+
+void vote_result_free(vote_result *result) { delete result; }
+
+size_t vote_result_round_count(vote_result const *result) {
+	if (result == NULL || result->candidate_count == 0) {
+		return 0;
+	}
+
+	return result->tallies.size() / result->candidate_count;
+}
+
+vote_tally const *vote_result_round(vote_result const *result, size_t round,
+                                    size_t *count) {
+	if (count != NULL) {
+		*count = 0;
+	}
+
+	if (round >= vote_result_round_count(result)) {
+		return NULL;
+	}
+
+	if (count != NULL) {
+		*count = result->candidate_count;
+	}
+
+	return result->tallies.data() + round * result->candidate_count;
+}
+
+size_t vote_result_winners(vote_result const *result,
+                           int32_t const    **winners) {
+	if (result == NULL) {
+		if (winners != NULL) {
+			*winners = NULL;
+		}
+		return 0;
+	}
+
+	if (winners != NULL) {
+		*winners = result->winners.data();
+	}
+
+	return result->winners.size();
+}
+
+size_t vote_result_transfers(vote_result const    *result,
+                             vote_transfer const **transfers) {
+	if (result == NULL) {
+		if (transfers != NULL) {
+			*transfers = NULL;
+		}
+		return 0;
+	}
+
+	if (transfers != NULL) {
+		*transfers = result->transfers.data();
+	}
+
+	return result->transfers.size();
+}
+
+char const *vote_ballot_candidate_name(vote_ballot const *ballot, int32_t id) {
+	if (ballot == NULL) {
+		return NULL;
+	}
+
+	for (struct vote::candidate const &candidate : ballot->ballot.candidates) {
+		if (candidate.id == id) {
+			return candidate.name.c_str();
+		}
+	}
+
+	return NULL;
+}
+}
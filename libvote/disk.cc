@@ -0,0 +1,357 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Depouillement hors memoire des classements deverses sur disque
+ */
+#include "libvote.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+namespace vote {
+spill::spill()
+	: fd(-1), chunk_size(0), candidate_count(0), unique(false), width(0),
+	  length(0), participants(0), size(0) {}
+
+spill::~spill() {
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+namespace disk {
+/**
+ * Ecrit tout un tampon dans un fichier, meme si l'ecriture est interrompue
+ */
+static bool write_all(int fd, void const *data, usize size) {
+	char const *bytes = (char const *)data;
+	isize       written;
+
+	while (size > 0) {
+		written = write(fd, bytes, size);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return false;
+		}
+
+		bytes += written;
+		size -= written;
+	}
+
+	return true;
+}
+
+/**
+ * Lit tout un tampon a une position donnee d'un fichier
+ */
+static void read_all(int fd, void *data, usize size, u64 offset) {
+	char *bytes = (char *)data;
+	isize got;
+
+	while (size > 0) {
+		got = pread(fd, bytes, size, offset);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			throw std::ios_base::failure("failed to read spilled ballots");
+		}
+
+		bytes += got;
+		size -= got;
+		offset += got;
+	}
+}
+
+/**
+ * Memoire qu'occupera le morceau en cours d'ecriture une fois relu
+ */
+static usize get_pending_size(struct spill const &spill) {
+	return spill.pending_ids.size() +
+	       spill.pending_counts.size() *
+	           (sizeof(struct participant) + sizeof(u32));
+}
+
+/**
+ * Ecrit le morceau en cours a la fin du fichier
+ */
+static bool flush(struct spill &spill) {
+	struct chunk chunk;
+	usize        i;
+
+	if (spill.pending_counts.empty()) {
+		return true;
+	}
+
+	chunk.offset       = spill.size;
+	chunk.participants = spill.pending_counts.size();
+	chunk.votes        = spill.pending_ids.size() / spill.width;
+	chunk.length       = spill.pending_counts[0];
+
+	for (i = 1; i < spill.pending_counts.size(); ++i) {
+		if (spill.pending_counts[i] != chunk.length) {
+			chunk.length = 0;
+			break;
+		}
+	}
+
+	/* les longueurs ne sont ecrites que si elles different */
+	if (chunk.length == 0) {
+		if (!write_all(spill.fd, spill.pending_counts.data(),
+		               spill.pending_counts.size() * sizeof(u32))) {
+			return false;
+		}
+		spill.size += spill.pending_counts.size() * sizeof(u32);
+	}
+
+	if (!write_all(spill.fd, spill.pending_ids.data(),
+	               spill.pending_ids.size())) {
+		return false;
+	}
+	spill.size += spill.pending_ids.size();
+
+	spill.chunks.push_back(chunk);
+	spill.pending_counts.clear();
+	spill.pending_ids.clear();
+
+	return true;
+}
+
+/**
+ * Ajoute un identifiant au morceau en cours sur <code>T</code>
+ */
+template <typename T> static void push_id(std::vector<u8> &ids, i32 id) {
+	T value = (T)id;
+
+	ids.resize(ids.size() + sizeof(T));
+	std::memcpy(ids.data() + ids.size() - sizeof(T), &value, sizeof(T));
+}
+
+bool create(usize budget, usize candidate_count, bool unique,
+            struct spill &spill) {
+	char const *directory = std::getenv("TMPDIR");
+	std::string path;
+
+	if (directory == NULL || *directory == '\0') {
+		directory = "/tmp";
+	}
+
+	path     = std::string(directory) + "/vote.XXXXXX";
+	spill.fd = mkstemp(&path[0]);
+	if (spill.fd < 0) {
+		return false;
+	}
+
+	/* le fichier disparait avec son dernier descripteur */
+	unlink(path.c_str());
+
+	spill.chunk_size      = std::max<usize>(budget / 2, 1);
+	spill.candidate_count = candidate_count;
+	spill.unique          = unique;
+	spill.length          = 0;
+	spill.participants    = 0;
+	spill.size            = 0;
+
+	if (candidate_count <= UINT8_MAX) {
+		spill.width = 1;
+	} else if (candidate_count <= UINT16_MAX) {
+		spill.width = 2;
+	} else {
+		spill.width = 4;
+	}
+
+	return true;
+}
+
+bool append(struct spill &spill, std::vector<i32> const &votes,
+            std::vector<u32> const &vote_counts, std::vector<u32> const &lines,
+            struct validation &validation) {
+	std::vector<u64> seen;
+	usize            vote = 0;
+	usize            i;
+	usize            j;
+	u32              rank;
+
+	if (spill.unique) {
+		seen.assign(spill.candidate_count / 64 + 1, 0);
+	}
+
+	for (i = 0; i < vote_counts.size(); ++i) {
+		u32 count = vote_counts[i];
+
+		/* meme verification que get_ballot() pour un vote en memoire. Un
+		 * participant refuse n'est pas deverse, le vote ne sera pas compte. */
+		if (spill.unique) {
+			rank = tally::find_invalid(votes.data() + vote, count,
+			                           spill.candidate_count, seen.data());
+		} else {
+			for (rank = 0; rank < count; ++rank) {
+				if (votes[vote + rank] < 1 ||
+				    (usize)votes[vote + rank] > spill.candidate_count) {
+					break;
+				}
+			}
+		}
+
+		if (rank < count) {
+			tally::reject(validation,
+			              spill.participants + validation.rejected, lines[i],
+			              votes.data() + vote, rank, spill.candidate_count);
+			vote += count;
+			continue;
+		}
+
+		for (j = vote; j < vote + count; ++j) {
+			if (spill.width == 1) {
+				push_id<u8>(spill.pending_ids, votes[j]);
+			} else if (spill.width == 2) {
+				push_id<u16>(spill.pending_ids, votes[j]);
+			} else {
+				push_id<u32>(spill.pending_ids, votes[j]);
+			}
+		}
+
+		if (spill.participants == 0) {
+			spill.length = count;
+		} else if (count != spill.length) {
+			spill.length = 0;
+		}
+
+		spill.pending_counts.push_back(count);
+		++spill.participants;
+		vote += count;
+
+		if (get_pending_size(spill) >= spill.chunk_size && !flush(spill)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool finish(struct spill &spill) {
+	if (!flush(spill)) {
+		return false;
+	}
+
+	/* le morceau en cours n'est plus necessaire */
+	std::vector<u32>().swap(spill.pending_counts);
+	std::vector<u8>().swap(spill.pending_ids);
+
+	return true;
+}
+
+template <typename T>
+static void read_ids(struct spill const &spill, struct chunk const &chunk,
+                     u64 offset, std::vector<T> &ids) {
+	ids.resize(chunk.votes);
+	read_all(spill.fd, ids.data(), ids.size() * sizeof(T), offset);
+}
+
+/**
+ * Relit un morceau sous la forme d'une liste de participants et de
+ * classements en memoire
+ */
+static void load(struct spill const &spill, struct chunk const &chunk,
+                 struct roll &roll, struct ranks &ranks) {
+	std::vector<u32> counts;
+	u64              offset = chunk.offset;
+	usize            first_vote;
+	usize            i;
+
+	if (chunk.length == 0) {
+		counts.resize(chunk.participants);
+		read_all(spill.fd, counts.data(), counts.size() * sizeof(u32),
+		         offset);
+		offset += counts.size() * sizeof(u32);
+	}
+
+	roll.participants.resize(chunk.participants);
+	roll.anonymous = true;
+
+	for (i = 0, first_vote = 0; i < chunk.participants; ++i) {
+		struct participant &participant = roll.participants[i];
+		u32                 count = chunk.length ? chunk.length : counts[i];
+
+		participant.name            = 0;
+		participant.last_name_size  = 0;
+		participant.first_name_size = 0;
+		participant.first_vote      = first_vote;
+		participant.vote_count      = count;
+		participant.line            = 0;
+
+		first_vote += participant.vote_count;
+	}
+
+	ranks.width  = spill.width;
+	ranks.word   = 0;
+	ranks.length = chunk.length;
+
+	if (spill.width == 1) {
+		read_ids(spill, chunk, offset, ranks.ids8);
+	} else if (spill.width == 2) {
+		read_ids(spill, chunk, offset, ranks.ids16);
+	} else {
+		read_ids(spill, chunk, offset, ranks.ids32);
+	}
+}
+
+void scan(struct ballot const &ballot, visitor const &visit) {
+	struct spill const           &spill = *ballot.ranks->spill;
+	std::shared_ptr<struct roll>  rolls[2];
+	std::shared_ptr<struct ranks> ranks[2];
+	struct ballot                 local;
+	std::exception_ptr            error;
+	usize                         i;
+
+	if (spill.chunks.empty()) {
+		return;
+	}
+
+	for (i = 0; i < 2; ++i) {
+		rolls[i] = std::make_shared<struct roll>();
+		ranks[i] = std::make_shared<struct ranks>();
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(spill.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	load(spill, spill.chunks[0], *rolls[0], *ranks[0]);
+
+	/* le morceau suivant est lu pendant que le morceau actuel est compte */
+	for (i = 0; i < spill.chunks.size(); ++i) {
+		std::thread reader;
+
+		if (i + 1 < spill.chunks.size()) {
+			reader = std::thread([&spill, &rolls, &ranks, &error, i]() {
+				try {
+					load(spill, spill.chunks[i + 1], *rolls[(i + 1) % 2],
+					     *ranks[(i + 1) % 2]);
+				} catch (std::ios_base::failure const &) {
+					error = std::current_exception();
+				}
+			});
+		}
+
+		local.roll  = rolls[i % 2];
+		local.ranks = ranks[i % 2];
+		visit(local);
+
+		if (reader.joinable()) {
+			reader.join();
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+}
+} // namespace disk
+} // namespace vote
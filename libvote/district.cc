@@ -0,0 +1,409 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Elections par district, depouillees en parallele
+ */
+#include "libvote.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+namespace vote::districts {
+/**
+ * Partie de l'entree qui contient des participants d'un district
+ */
+struct block {
+	/**
+	 * Indice du district dans le vecteur renvoye par parse()
+	 */
+	usize district;
+	/**
+	 * Debut du bloc dans l'entree
+	 */
+	usize begin;
+	/**
+	 * Fin du bloc dans l'entree
+	 */
+	usize end;
+	/**
+	 * Nombre de lignes de l'entree avant le bloc
+	 */
+	usize line;
+	/**
+	 * Nombre de participants du bloc, connu apres sa lecture
+	 */
+	usize participants;
+};
+
+/**
+ * Applique une fonction a tous les indices de 0 a <code>count</code>, repartis
+ * entre plusieurs fils d'execution qui les prennent un par un dans un
+ * compteur partage
+ *
+ * @param count  Nombre d'indices
+ * @param jobs   Nombre de fils d'execution, tous les coeurs s'il est 0
+ * @param work   La fonction, appelee avec chaque indice
+ */
+template <typename F> static void for_each(usize count, usize jobs, F work) {
+	std::vector<std::thread> threads;
+	std::atomic<usize>       next(0);
+	usize                    i;
+
+	if (jobs == 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+	jobs = std::min(jobs, std::max<usize>(count, 1));
+
+	for (i = 0; i < jobs; ++i) {
+		threads.emplace_back([&next, &work, count]() {
+			usize n;
+
+			while ((n = next++) < count) {
+				work(n);
+			}
+		});
+	}
+
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+}
+
+/**
+ * Indique si une ligne marque le debut d'un district : son nom entre
+ * crochets, avec d'eventuels espaces autour
+ *
+ * @param begin  Debut de la ligne
+ * @param end    Fin de la ligne
+ * @param name   Le nom du district
+ * @return  Valeur booleenne indiquant que la ligne est un district
+ */
+static bool is_marker(char const *begin, char const *end, std::string &name) {
+	while (begin < end && *begin == ' ') {
+		++begin;
+	}
+	while (end > begin && (end[-1] == ' ' || end[-1] == '\r')) {
+		--end;
+	}
+
+	if (end - begin < 2 || *begin != '[' || end[-1] != ']') {
+		return false;
+	}
+
+	name.assign(begin + 1, end - 1);
+	return true;
+}
+
+/**
+ * Garde les voix du premier tour d'un district, voir
+ * <code>district.first_round</code>
+ */
+static void record_first_round(struct ballot const &ballot, void *data) {
+	std::vector<usize> &votes = *(std::vector<usize> *)data;
+
+	if (ballot.round != 1) {
+		return;
+	}
+
+	votes.assign(ballot.candidates.size() + 1, 0);
+	for (struct candidate const &candidate : ballot.candidates) {
+		votes[candidate.id] = candidate.votes;
+	}
+}
+
+/**
+ * Lit les participants d'un bloc a la suite d'une liste
+ *
+ * @param block  Le bloc
+ * @param data   L'entree
+ * @param rows   Indique que le bloc a un participant par ligne
+ * @param roll   La liste des participants
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+static bool parse_block(struct block const &block, char const *data,
+                        bool rows, struct roll &roll) {
+	input::memory buffer(data + block.begin, block.end - block.begin);
+	std::istream  stream(&buffer);
+	struct roll   parsed;
+	usize         first;
+	usize         names;
+	usize         votes;
+	usize         i;
+
+	/* les lignes sont comptees depuis le debut du bloc */
+	if (!rows) {
+		first = roll.participants.size();
+		if (!parser::parse_participants(stream, roll, 0)) {
+			return false;
+		}
+
+		for (i = first; i < roll.participants.size(); ++i) {
+			roll.participants[i].line = std::min<usize>(
+				roll.participants[i].line + block.line, UINT32_MAX);
+		}
+		return true;
+	}
+
+	std::vector<struct candidate> candidates;
+
+	/* un bloc vide n'a aucun participant, ce que rows::parse() refuse */
+	parsed.anonymous = roll.anonymous;
+	if (!rows::parse(stream, candidates, parsed)) {
+		return parsed.participants.empty() && candidates.empty();
+	}
+	if (!candidates.empty()) {
+		return false;
+	}
+
+	names = roll.names.size();
+	votes = roll.votes.size();
+
+	for (struct participant participant : parsed.participants) {
+		participant.name += names;
+		participant.first_vote += votes;
+		participant.line = std::min<usize>(participant.line + block.line,
+		                                   UINT32_MAX);
+		roll.participants.push_back(participant);
+	}
+
+	roll.names += parsed.names;
+	roll.votes.insert(roll.votes.end(), parsed.votes.begin(),
+	                  parsed.votes.end());
+
+	return true;
+}
+
+/**
+ * Trouve le rang dans l'entree d'un participant d'un district
+ *
+ * @param blocks    Les blocs, deja lus
+ * @param district  Indice du district
+ * @param index     Indice du participant dans la liste du district
+ * @return  Indice du participant parmi tous ceux de l'entree
+ */
+static usize get_index(std::vector<struct block> const &blocks,
+                       usize district, usize index) {
+	usize offset = 0;
+
+	for (struct block const &block : blocks) {
+		if (block.district == district) {
+			if (index < block.participants) {
+				break;
+			}
+			index -= block.participants;
+		}
+		offset += block.participants;
+	}
+
+	return offset + index;
+}
+
+bool parse(std::istream &stream, bool rows, bool anonymous, bool unique,
+           usize jobs, std::vector<struct candidate> &candidates,
+           std::vector<struct district> &districts,
+           struct validation            &validation) {
+	std::string                    data;
+	std::string                    name;
+	std::vector<struct block>      blocks;
+	std::vector<std::string>       names;
+	std::vector<char>              failed;
+	std::vector<struct validation> validations;
+	struct validation              rejected;
+	char                      chunk[1 << 16];
+	std::streamsize           size;
+	usize                     header;
+	usize                     line;
+	usize                     number;
+	usize                     i;
+
+	while ((size = stream.rdbuf()->sgetn(chunk, sizeof(chunk))) > 0) {
+		data.append(chunk, size);
+	}
+	if (stream.bad()) {
+		return false;
+	}
+
+	/* les blocs de chaque district, jusqu'au marqueur suivant */
+	header = data.size();
+	for (line = 0, number = 0; line < data.size();) {
+		char const *begin = data.data() + line;
+		char const *end;
+		usize       next;
+
+		end = (char const *)std::memchr(begin, '\n', data.size() - line);
+		if (end == nullptr) {
+			end  = data.data() + data.size();
+			next = data.size();
+		} else {
+			next = end - data.data() + 1;
+		}
+
+		++number;
+
+		if (is_marker(begin, end, name)) {
+			auto it = std::find(names.begin(), names.end(), name);
+
+			if (blocks.empty()) {
+				header = line;
+			} else {
+				blocks.back().end = line;
+			}
+
+			blocks.push_back(
+				{(usize)(it - names.begin()), next, data.size(), number, 0});
+			if (it == names.end()) {
+				names.push_back(name);
+			}
+		}
+
+		line = next;
+	}
+
+	if (blocks.empty()) {
+		return false;
+	}
+
+	/* les glaces sont toutes les lignes avant le premier district */
+	{
+		input::memory buffer(data.data(), header);
+		std::istream  glaces(&buffer);
+
+		while (parser::read_string(glaces, name)) {
+			struct candidate candidate;
+
+			if (rows && name.back() == '\r') {
+				name.pop_back();
+			}
+
+			candidate.id         = candidates.size() + 1;
+			candidate.name       = name;
+			candidate.votes      = 0;
+			candidate.last_votes = 0;
+			candidate.eliminated = false;
+
+			candidates.push_back(candidate);
+		}
+	}
+
+	if (candidates.empty()) {
+		return false;
+	}
+
+	districts.resize(names.size());
+	failed.assign(names.size(), false);
+	validations.resize(names.size());
+
+	/* chaque district est lu par un seul fil d'execution, dans l'ordre de ses
+	 * blocs */
+	for_each(names.size(), jobs, [&](usize n) {
+		struct district &district = districts[n];
+		struct roll      roll;
+		usize            first;
+
+		district.name  = names[n];
+		roll.anonymous = anonymous;
+
+		for (struct block &block : blocks) {
+			if (block.district != n) {
+				continue;
+			}
+
+			first = roll.participants.size();
+			if (!parse_block(block, data.data(), rows, roll)) {
+				failed[n] = true;
+				return;
+			}
+			block.participants = roll.participants.size() - first;
+		}
+
+		failed[n] = roll.participants.empty() ||
+		            !get_ballot(candidates, std::move(roll), district.ballot,
+		                        unique, validations[n]);
+	});
+
+	/* les participants refuses de tous les districts, dans l'ordre de
+	 * l'entree */
+	rejected.rejected = 0;
+	for (i = 0; i < names.size(); ++i) {
+		rejected.rejected += validations[i].rejected;
+
+		for (struct rejection rejection : validations[i].rejections) {
+			rejection.participant =
+				get_index(blocks, i, rejection.participant);
+			rejected.rejections.push_back(rejection);
+		}
+	}
+
+	std::sort(rejected.rejections.begin(), rejected.rejections.end(),
+	          [](struct rejection const &a, struct rejection const &b) {
+				  return a.participant < b.participant;
+			  });
+
+	validation.rejected = 0;
+	validation.rejections.clear();
+	tally::merge(validation, rejected);
+
+	for (i = 0; i < names.size(); ++i) {
+		if (failed[i]) {
+			districts.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool run(std::vector<struct district> &districts, analysis::system system,
+         usize jobs) {
+	std::atomic<bool> success(true);
+
+	for_each(districts.size(), jobs, [&](usize n) {
+		struct district &district = districts[n];
+
+		/* les tours de districts paralleles ne sont pas affiches */
+		district.ballot.verbose       = false;
+		district.ballot.observer      = record_first_round;
+		district.ballot.observer_data = &district.first_round;
+
+		district.success = system(district.ballot);
+		if (!district.success) {
+			success = false;
+		}
+	});
+
+	return success;
+}
+
+void count_seats(std::vector<struct district> const &districts,
+                 std::vector<usize>                 &seats) {
+	usize size = districts.empty()
+	                 ? 0
+	                 : districts[0].ballot.candidates.size() + 1;
+
+	seats.assign(size, 0);
+
+	for (struct district const &district : districts) {
+		if (district.success && !district.ballot.winners.empty()) {
+			++seats[district.ballot.winners[0]];
+		}
+	}
+}
+
+void count_first_round(std::vector<struct district> const &districts,
+                       std::vector<usize>                 &votes) {
+	usize i;
+
+	votes.clear();
+
+	for (struct district const &district : districts) {
+		if (votes.size() < district.first_round.size()) {
+			votes.resize(district.first_round.size(), 0);
+		}
+
+		for (i = 0; i < district.first_round.size(); ++i) {
+			votes[i] += district.first_round[i];
+		}
+	}
+}
+} // namespace vote::districts
@@ -0,0 +1,311 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Lecture d'entrees compressees avec gzip ou zstd
+ */
+#include "libvote.hh"
+
+#include <cstring>
+
+#ifdef VOTE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef VOTE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace vote::input {
+/**
+ * Taille des tampons d'entree et de sortie
+ */
+static usize const buffer_size = 1 << 16;
+
+/**
+ * Tampon de flux qui lit un autre tampon de flux et le decompresse au fur et
+ * a mesure, sans jamais garder plus de deux tampons en memoire
+ */
+struct decompressor : public std::streambuf {
+	/**
+	 * Le tampon de flux compresse
+	 */
+	std::streambuf *source;
+	/**
+	 * Le format du flux compresse
+	 */
+	enum format format;
+	/**
+	 * Donnees compressees lues mais pas encore decompressees
+	 */
+	std::vector<char> in;
+	/**
+	 * Position des prochaines donnees compressees dans <code>in</code>
+	 */
+	usize in_pos;
+	/**
+	 * Nombre de donnees compressees dans <code>in</code>
+	 */
+	usize in_size;
+	/**
+	 * Indique que le tampon compresse est termine
+	 */
+	bool eof;
+	/**
+	 * Indique que le dernier bloc compresse a ete entierement decompresse
+	 */
+	bool complete;
+	/**
+	 * Indique qu'une erreur de decompression a termine le flux
+	 */
+	bool failed;
+	/**
+	 * Flux mis dans l'etat <code>bad()</code> en cas d'erreur, meme quand le
+	 * tampon est lu directement avec <code>sgetn()</code>
+	 */
+	std::ios *owner;
+	/**
+	 * Donnees decompressees
+	 */
+	std::vector<char> out;
+#ifdef VOTE_HAVE_ZLIB
+	z_stream zlib_stream;
+#endif
+#ifdef VOTE_HAVE_ZSTD
+	ZSTD_DStream *zstd_stream;
+#endif
+
+	decompressor(std::streambuf *source, enum format format,
+	             char const *magic, usize magic_size)
+		: source(source), format(format), in(buffer_size), in_pos(0),
+		  in_size(magic_size), eof(false), complete(true), failed(false),
+		  owner(nullptr), out(buffer_size) {
+		std::memcpy(in.data(), magic, magic_size);
+
+#ifdef VOTE_HAVE_ZLIB
+		if (format == gzip) {
+			std::memset(&zlib_stream, 0, sizeof(zlib_stream));
+			/* 32 : detection automatique des en-tetes gzip et zlib */
+			inflateInit2(&zlib_stream, 15 + 32);
+		}
+#endif
+#ifdef VOTE_HAVE_ZSTD
+		if (format == zstd) {
+			zstd_stream = ZSTD_createDStream();
+			ZSTD_initDStream(zstd_stream);
+		}
+#endif
+	}
+
+	~decompressor() override {
+#ifdef VOTE_HAVE_ZLIB
+		if (format == gzip) {
+			inflateEnd(&zlib_stream);
+		}
+#endif
+#ifdef VOTE_HAVE_ZSTD
+		if (format == zstd) {
+			ZSTD_freeDStream(zstd_stream);
+		}
+#endif
+	}
+
+	/**
+	 * Remplit <code>in</code> s'il est vide
+	 */
+	void refill() {
+		if (in_pos == in_size && !eof) {
+			in_pos  = 0;
+			in_size = source->sgetn(in.data(), in.size());
+			eof     = in_size == 0;
+		}
+	}
+
+	/**
+	 * Decompresse la suite du flux dans <code>out</code>
+	 *
+	 * @return  Nombre d'octets decompresses, 0 a la fin du flux
+	 */
+	usize decompress() {
+		for (;;) {
+			usize produced = 0;
+			usize consumed;
+
+			refill();
+
+			if (format == plain) {
+				produced = in_size - in_pos;
+				std::memcpy(out.data(), in.data() + in_pos, produced);
+				in_pos = in_size;
+				return produced;
+			}
+
+			if (in_pos == in_size) {
+				/* un flux coupe au milieu d'un bloc est une erreur */
+				if (!complete) {
+					throw std::ios_base::failure("truncated compressed input");
+				}
+				return 0;
+			}
+
+			consumed = in_pos;
+
+#ifdef VOTE_HAVE_ZLIB
+			if (format == gzip) {
+				int ret;
+
+				/* plusieurs membres gzip peuvent se suivre ; des octets nuls
+				 * apres un membre (bourrage d'un bloc) terminent le flux */
+				if (complete) {
+					while (in_pos < in_size && in[in_pos] == 0) {
+						++in_pos;
+					}
+					if (in_pos == in_size) {
+						continue;
+					}
+
+					inflateReset(&zlib_stream);
+				}
+
+				zlib_stream.next_in   = (Bytef *)in.data() + in_pos;
+				zlib_stream.avail_in  = in_size - in_pos;
+				zlib_stream.next_out  = (Bytef *)out.data();
+				zlib_stream.avail_out = out.size();
+
+				ret      = inflate(&zlib_stream, Z_NO_FLUSH);
+				in_pos   = in_size - zlib_stream.avail_in;
+				produced = out.size() - zlib_stream.avail_out;
+				complete = ret == Z_STREAM_END;
+
+				if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+					throw std::ios_base::failure("invalid gzip input");
+				}
+			}
+#endif
+#ifdef VOTE_HAVE_ZSTD
+			if (format == zstd) {
+				ZSTD_inBuffer  src = {in.data(), in_size, in_pos};
+				ZSTD_outBuffer dst = {out.data(), out.size(), 0};
+				usize          ret;
+
+				ret = ZSTD_decompressStream(zstd_stream, &dst, &src);
+				if (ZSTD_isError(ret)) {
+					throw std::ios_base::failure("invalid zstd input");
+				}
+
+				in_pos   = src.pos;
+				produced = dst.pos;
+				complete = ret == 0;
+			}
+#endif
+
+			if (produced > 0) {
+				return produced;
+			}
+			if (in_pos == consumed) {
+				throw std::ios_base::failure("invalid compressed input");
+			}
+		}
+	}
+
+	int_type underflow() override {
+		usize size = 0;
+
+		if (failed) {
+			return traits_type::eof();
+		}
+
+		/* l'erreur ne doit pas sortir d'un appel direct a sgetn() */
+		try {
+			size = decompress();
+		} catch (std::ios_base::failure const &) {
+			failed = true;
+			if (owner != nullptr) {
+				owner->setstate(std::ios_base::badbit);
+			}
+		}
+
+		if (size == 0) {
+			return traits_type::eof();
+		}
+
+		setg(out.data(), out.data(), out.data() + size);
+		return traits_type::to_int_type(out[0]);
+	}
+};
+
+/**
+ * Flux d'entree qui possede son tampon de decompression
+ */
+struct stream : public std::istream {
+	struct decompressor buffer;
+
+	stream(std::streambuf *source, enum format format, char const *magic,
+	       usize magic_size)
+		: std::istream(nullptr), buffer(source, format, magic, magic_size) {
+		rdbuf(&buffer);
+		buffer.owner = this;
+	}
+};
+
+std::unique_ptr<std::istream> open(std::istream &source,
+                                   enum format  &format) {
+	unsigned char magic[4];
+	usize         size;
+
+	size = source.rdbuf()->sgetn((char *)magic, sizeof(magic));
+
+	format = plain;
+	if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+		format = gzip;
+	} else if (size == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+	           magic[2] == 0x2f && magic[3] == 0xfd) {
+		format = zstd;
+	}
+
+#ifndef VOTE_HAVE_ZLIB
+	if (format == gzip) {
+		return nullptr;
+	}
+#endif
+#ifndef VOTE_HAVE_ZSTD
+	if (format == zstd) {
+		return nullptr;
+	}
+#endif
+
+	return std::unique_ptr<std::istream>(
+		new struct stream(source.rdbuf(), format, (char const *)magic, size));
+}
+
+memory::memory(char const *data, usize size) {
+	char *begin = const_cast<char *>(data);
+
+	setg(begin, begin, begin + size);
+}
+
+memory::pos_type memory::seekoff(off_type off, std::ios_base::seekdir dir,
+                                 std::ios_base::openmode which) {
+	off_type base;
+
+	if (!(which & std::ios_base::in)) {
+		return pos_type(off_type(-1));
+	}
+
+	if (dir == std::ios_base::beg) {
+		base = 0;
+	} else if (dir == std::ios_base::cur) {
+		base = gptr() - eback();
+	} else {
+		base = egptr() - eback();
+	}
+
+	if (base + off < 0 || base + off > egptr() - eback()) {
+		return pos_type(off_type(-1));
+	}
+
+	setg(eback(), eback() + base + off, egptr());
+	return pos_type(base + off);
+}
+
+memory::pos_type memory::seekpos(pos_type pos, std::ios_base::openmode which) {
+	return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+} // namespace vote::input
@@ -6,31 +6,84 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
 #include <cstdlib>
 #include <ctime>
 
 namespace vote {
-bool get_ballot(std::vector<struct candidate>   candidates,
-                std::vector<struct participant> participants,
-                struct ballot                  &b) {
+/**
+ * Initialise les champs d'un vote qui ne dependent pas des participants
+ */
+static void reset_ballot(std::vector<struct candidate> &candidates,
+                         struct ballot                 &b) {
 	for (struct candidate &candidate : candidates) {
 		candidate.votes      = 0;
 		candidate.last_votes = 0;
 		candidate.eliminated = false;
 	}
 
+	b.candidates = std::move(candidates);
+	b.sample.clear();
+	b.winners.clear();
+	b.round         = 1;
+	b.batch         = false;
+	b.verbose       = true;
+	b.observer      = nullptr;
+	b.observer_data = nullptr;
+	b.collapsed.clear();
+	b.transfers.clear();
+	b.first_round = {};
+	b.checkpoints = nullptr;
+}
+
+bool get_ballot(std::vector<struct candidate> candidates, struct roll roll,
+                struct ballot &b) {
+	struct validation validation;
+
+	return get_ballot(std::move(candidates), std::move(roll), b, false,
+	                  validation);
+}
+
+bool get_ballot(std::vector<struct candidate> candidates, struct roll roll,
+                struct ballot &b, bool unique, struct validation &validation) {
+	struct ranks ranks;
+
 	/* verification de l'entree utilisateur */
-	for (struct participant participant : participants) {
-		for (i32 id : participant.votes) {
-			if (id < 1 || (usize)id > candidates.size()) {
-				return false;
-			}
-		}
+	if (!tally::get_ranks(roll, candidates.size(), unique, ranks,
+	                      validation)) {
+		return false;
+	}
+
+	/* les votes sont maintenant dans ranks */
+	std::vector<i32>().swap(roll.votes);
+
+	reset_ballot(candidates, b);
+	b.roll  = std::make_shared<struct roll const>(std::move(roll));
+	b.ranks = std::make_shared<struct ranks const>(std::move(ranks));
+
+	return true;
+}
+
+bool get_ballot(std::vector<struct candidate>       candidates,
+                std::shared_ptr<struct spill const> spill,
+                struct ballot                      &b) {
+	struct roll  roll;
+	struct ranks ranks;
+
+	/* les identifiants ont ete verifies par disk::append() */
+	if (!spill || spill->candidate_count != candidates.size()) {
+		return false;
 	}
 
-	b.candidates   = candidates;
-	b.participants = participants;
-	b.round        = 1;
+	roll.anonymous = true;
+	ranks.width    = spill->width;
+	ranks.word     = 0;
+	ranks.length   = spill->length;
+	ranks.spill    = std::move(spill);
+
+	reset_ballot(candidates, b);
+	b.roll  = std::make_shared<struct roll const>(std::move(roll));
+	b.ranks = std::make_shared<struct ranks const>(std::move(ranks));
 
 	return true;
 }
@@ -59,6 +112,14 @@ bool is_eliminated(struct ballot &ballot, i32 candidate_id) {
 void print_vote(struct ballot &ballot) {
 	std::vector<struct candidate> candidates;
 
+	if (ballot.observer != nullptr) {
+		ballot.observer(ballot, ballot.observer_data);
+	}
+
+	if (!ballot.verbose) {
+		return;
+	}
+
 	candidates = ballot.candidates;
 	std::sort(candidates.begin(), candidates.end(), compare_candidates);
 	std::reverse(candidates.begin(), candidates.end());
@@ -84,7 +145,7 @@ void print_vote(struct ballot &ballot) {
 }
 
 namespace parser {
-static bool is_last_name(std::string const &s) {
+bool is_last_name(std::string const &s) {
 	for (char c : s) {
 		if (isalpha(c) && islower(c)) {
 			return false;
@@ -94,10 +155,17 @@ static bool is_last_name(std::string const &s) {
 }
 
 bool read_string(std::istream &stream, std::string &string) {
+	usize line = 0;
+
+	return read_string(stream, string, line);
+}
+
+bool read_string(std::istream &stream, std::string &string, usize &line) {
 	for (;;) {
 		if (!std::getline(stream, string)) {
 			return false;
 		}
+		++line;
 
 		/* si la ligne est vide, contient que des espaces, ou est un commentaire
 		 * on l'ignore */
@@ -111,26 +179,84 @@ bool read_string(std::istream &stream, std::string &string) {
 	}
 }
 
-bool parse_int(std::istream &stream, i32 &integer) {
+bool to_int(std::string const &s, i32 &integer) {
+	char const *begin = s.c_str();
+	char       *end;
+	long        value;
+
+	/* meme regles que std::stoi, mais une ligne qui n'est pas un entier (le
+	 * nom du participant suivant) ne coute pas une exception */
+	errno = 0;
+	value = std::strtol(begin, &end, 10);
+	if (end == begin || errno == ERANGE || value < INT32_MIN ||
+	    value > INT32_MAX) {
+		return false;
+	}
+
+	integer = (i32)value;
+	return true;
+}
+
+/**
+ * Lit un entier comme parse_int(), en comptant les lignes lues. Si la ligne
+ * n'est pas un entier, le flux et le compteur sont remis ou ils etaient.
+ */
+static bool read_int(std::istream &stream, i32 &integer, usize &line) {
 	std::streampos pos;
 	std::string    s;
+	usize          previous = line;
 
 	pos = stream.tellg();
 
-	if (read_string(stream, s)) {
-		try {
-			integer = std::stoi(s);
+	if (read_string(stream, s, line)) {
+		if (to_int(s, integer)) {
 			return true;
-		} catch (std::invalid_argument const &e) {
-		} catch (std::out_of_range const &e) {
 		}
 
 		stream.seekg(pos, std::ios::beg);
 	}
 
+	line = previous;
 	return false;
 }
 
+bool parse_int(std::istream &stream, i32 &integer) {
+	usize line = 0;
+
+	return read_int(stream, integer, line);
+}
+
+/**
+ * Nombre de lignes avant la position actuelle d'un flux, sans la deplacer
+ */
+static usize count_lines(std::istream &stream) {
+	std::streampos  pos = stream.tellg();
+	std::streamoff  left;
+	std::streamsize got;
+	char            chunk[1 << 12];
+	usize           lines = 0;
+
+	if (pos <= 0) {
+		return 0;
+	}
+
+	stream.seekg(0, std::ios::beg);
+	for (left = pos; left > 0; left -= got) {
+		stream.read(chunk, std::min<std::streamoff>(left, sizeof(chunk)));
+		got = stream.gcount();
+		if (got <= 0) {
+			break;
+		}
+
+		lines += std::count(chunk, chunk + got, '\n');
+	}
+
+	stream.clear();
+	stream.seekg(pos, std::ios::beg);
+
+	return lines;
+}
+
 bool parse_candidates(std::istream                  &stream,
                       std::vector<struct candidate> &candidates, usize count) {
 	bool guess;
@@ -176,33 +302,53 @@ bool parse_candidates(std::istream                  &stream,
 	return true;
 }
 
-bool parse_participants(std::istream                    &stream,
-                        std::vector<struct participant> &participants,
-                        usize                            count) {
-	bool guess;
+bool parse_participants(std::istream &stream, struct roll &roll, usize count) {
+	std::string line;
+	usize       number;
+	bool        guess;
+
+	number = count_lines(stream);
 
+	/* la ligne est reutilisee d'un participant a l'autre : les noms et les
+	 * votes ne sont copies qu'une fois, a la fin de roll.names et roll.votes,
+	 * sans allocation par participant */
 	for (guess = (count == 0); guess || (count > 0); --count) {
 		struct participant participant;
-		std::string        tmp;
 		i32                id;
 
-		if (!read_string(stream, participant.last_name)) {
+		participant.name            = roll.names.size();
+		participant.last_name_size  = 0;
+		participant.first_name_size = 0;
+		participant.first_vote      = roll.votes.size();
+		participant.vote_count      = 0;
+
+		if (!read_string(stream, line, number)) {
 			return guess && stream.eof();
 		}
-		if (!read_string(stream, participant.first_name)) {
+		participant.line = std::min<usize>(number, UINT32_MAX);
+		if (!roll.anonymous) {
+			participant.last_name_size = line.size();
+			roll.names += line;
+		}
+		if (!read_string(stream, line, number)) {
 			return false;
 		}
-		while (parse_int(stream, id)) {
+		if (!roll.anonymous) {
+			participant.first_name_size = line.size();
+			roll.names += line;
+		}
+		while (read_int(stream, id, number)) {
 			if (id < 1) {
 				return false;
 			}
-			participant.votes.push_back(id);
+			roll.votes.push_back(id);
+			++participant.vote_count;
 		}
-		if (participant.votes.size() == 0) {
+		if (participant.vote_count == 0) {
 			return false;
 		}
 
-		participants.push_back(participant);
+		roll.participants.push_back(participant);
 	}
 
 	return true;
@@ -220,6 +366,31 @@ void begin_round(struct ballot &ballot) {
 	ballot.winners.clear();
 }
 
+void count_first(struct ballot &ballot, std::vector<i32> const &eliminated,
+                 std::vector<usize> &votes) {
+	std::vector<usize> transfers;
+	usize              size = ballot.candidates.size() + 1;
+	usize              i;
+	usize              j;
+
+	if (eliminated.empty()) {
+		tally::count_first(ballot, votes);
+		return;
+	}
+
+	tally::count_transfers(ballot, eliminated, votes, transfers);
+
+	for (i = 0; i < eliminated.size(); ++i) {
+		for (j = 0; j < size; ++j) {
+			if (transfers[i * size + j] > 0) {
+				ballot.transfers.push_back(
+					{ballot.round, eliminated[i], (i32)j,
+				     transfers[i * size + j]});
+			}
+		}
+	}
+}
+
 double get_vote_fraction(struct ballot          &ballot,
                          struct candidate const &candidate) {
 	usize sum;
@@ -240,12 +411,17 @@ void init() { std::srand(std::time(0)); }
 
 bool generate_vote(std::ostream                        &stream,
                    std::vector<struct candidate> const &candidates,
-                   std::vector<struct participant>     &participants,
-                   usize                                vote_count) {
+                   struct roll const &roll, usize vote_count) {
 
 	std::vector<i32> vote_indices(candidates.size());
+	std::vector<i32> votes;
 	usize            i;
 
+	/* sans les noms, on ne peut pas ecrire un fichier d'entree valide */
+	if (roll.anonymous) {
+		return false;
+	}
+
 	vote_count = std::min(vote_count, candidates.size());
 
 	for (i = 0; i < vote_indices.size(); ++i) {
@@ -262,12 +438,12 @@ bool generate_vote(std::ostream                        &stream,
 
 	stream << std::endl << "// participants" << std::endl << std::endl;
 
-	for (struct participant &participant : participants) {
+	for (struct participant const &participant : roll.participants) {
 		usize j;
 		usize n;
 
-		stream << participant.last_name << std::endl;
-		stream << participant.first_name << std::endl;
+		stream << get_last_name(roll, participant) << std::endl;
+		stream << get_first_name(roll, participant) << std::endl;
 
 		if (vote_count == 0) {
 			n = 1 + (u32)std::rand() % vote_indices.size();
@@ -275,17 +451,14 @@ bool generate_vote(std::ostream                        &stream,
 			n = vote_count;
 		}
 
-		participant.votes = vote_indices;
+		votes = vote_indices;
 
 		for (j = 0; j < n; ++j) {
-			std::swap(participant.votes[j],
-			          participant.votes[std::rand() % vote_indices.size()]);
+			std::swap(votes[j], votes[std::rand() % vote_indices.size()]);
 		}
 
-		participant.votes.resize(n);
-
 		for (j = 0; j < n; ++j) {
-			stream << participant.votes[j] << std::endl;
+			stream << votes[j] << std::endl;
 		}
 
 		stream << std::endl;
@@ -0,0 +1,259 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Interface C de la bibliotheque, stable d'une version a l'autre
+ *
+ * Cette interface permet d'utiliser les systemes de votes depuis un autre
+ * programme sans passer par le texte : les glaces et les classements sont
+ * passes sous forme de tableaux et le detail de chaque tour est renvoye sous
+ * forme de structures. Aucune exception C++ ne la traverse.
+ */
+#ifndef LIBVOTE_H
+#define LIBVOTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Les symboles de l'interface C sont les seuls exportes par la bibliotheque
+ * partagee
+ */
+#if defined(VOTE_BUILD_SHARED) && defined(__GNUC__)
+#define VOTE_API __attribute__((visibility("default")))
+#else
+#define VOTE_API
+#endif
+
+/**
+ * Version de l'interface C, incrementee seulement si elle change de facon
+ * incompatible
+ */
+#define VOTE_API_VERSION 1
+
+/**
+ * Codes de retour des fonctions
+ */
+typedef enum vote_status {
+	/**
+	 * Succes
+	 */
+	VOTE_OK = 0,
+	/**
+	 * Un argument est nul ou hors limites
+	 */
+	VOTE_ERROR_ARGUMENT = 1,
+	/**
+	 * Un classement contient un identifiant qui ne correspond a aucune
+	 * glace, ou classe deux fois la meme glace pour un autre systeme que le
+	 * vote majoritaire (qui lit le choix de chaque tour a la suite)
+	 */
+	VOTE_ERROR_INVALID = 2,
+	/**
+	 * Le systeme de votes n'a pas pu etre applique, par exemple un vote
+	 * majoritaire avec des classements qui ne sont pas de longueur 2
+	 */
+	VOTE_ERROR_FAILED = 3,
+	/**
+	 * Memoire insuffisante
+	 */
+	VOTE_ERROR_MEMORY = 4
+} vote_status;
+
+/**
+ * Systemes de votes
+ */
+typedef enum vote_system {
+	/**
+	 * Vote majoritaire a 2 tours
+	 */
+	VOTE_TWO_ROUND = 0,
+	/**
+	 * Vote alternatif
+	 */
+	VOTE_INSTANT_RUNOFF = 1,
+	/**
+	 * Vote preferentiel (methode de Coombs)
+	 */
+	VOTE_RANKED = 2
+} vote_system;
+
+/**
+ * Option de vote_run() : pour le vote alternatif, elimine en un seul tour
+ * toutes les glaces qui ne peuvent plus gagner
+ */
+#define VOTE_FLAG_BATCH 1u
+
+/**
+ * Vote pret a etre depouille, opaque
+ */
+typedef struct vote_ballot vote_ballot;
+
+/**
+ * Resultat d'un vote, opaque
+ */
+typedef struct vote_result vote_result;
+
+/**
+ * Etat d'une glace a la fin d'un tour
+ */
+typedef struct vote_tally {
+	/**
+	 * Identifiant de la glace, a partir de 1
+	 */
+	int32_t id;
+	/**
+	 * Indique si la glace est eliminee
+	 */
+	int32_t eliminated;
+	/**
+	 * Nombre de voix. Une glace eliminee garde les voix de son dernier tour.
+	 */
+	uint64_t votes;
+	/**
+	 * Pour le vote preferentiel : voix en derniere place, cumulees depuis le
+	 * premier tour
+	 */
+	uint64_t last_votes;
+} vote_tally;
+
+/**
+ * Report des voix d'une glace eliminee, pour le vote alternatif et le vote
+ * preferentiel
+ */
+typedef struct vote_transfer {
+	/**
+	 * Le tour qui compte les voix reportees, a partir de 1
+	 */
+	uint32_t round;
+	/**
+	 * Identifiant de la glace eliminee
+	 */
+	int32_t from;
+	/**
+	 * Identifiant de la glace qui recoit les voix, 0 pour les participants
+	 * qui n'ont classe aucune autre glace encore en lice
+	 */
+	int32_t to;
+	/**
+	 * Nombre de voix reportees
+	 */
+	uint64_t votes;
+} vote_transfer;
+
+/**
+ * Version de l'interface C de la bibliotheque chargee
+ *
+ * @return  <code>VOTE_API_VERSION</code> au moment de sa compilation
+ */
+VOTE_API unsigned vote_api_version(void);
+
+/**
+ * Cree un vote a partir de tableaux. Les tableaux sont copies et peuvent etre
+ * liberes des le retour de la fonction.
+ *
+ * @param names              Noms des glaces, la glace <code>i</code> ayant
+ *                           l'identifiant <code>i + 1</code>
+ * @param candidate_count    Nombre de glaces
+ * @param ids                Identifiants classes par tous les participants,
+ *                           mis bout a bout dans l'ordre des participants
+ * @param lengths            Longueur du classement de chaque participant
+ * @param participant_count  Nombre de participants
+ * @param ballot             Le vote cree, a liberer avec vote_ballot_free()
+ * @return  <code>VOTE_OK</code> ou un code d'erreur
+ */
+VOTE_API vote_status vote_ballot_create(char const *const *names,
+                                        size_t             candidate_count,
+                                        int32_t const     *ids,
+                                        uint32_t const    *lengths,
+                                        size_t             participant_count,
+                                        vote_ballot      **ballot);
+
+/**
+ * Libere un vote. Un pointeur nul est ignore.
+ *
+ * @param ballot  Le vote
+ */
+VOTE_API void vote_ballot_free(vote_ballot *ballot);
+
+/**
+ * Applique un systeme de votes. Le vote n'est pas modifie : plusieurs fils
+ * d'execution peuvent appliquer des systemes sur le meme vote en meme temps.
+ *
+ * @param ballot  Le vote
+ * @param system  Le systeme de votes
+ * @param flags   Options, par exemple <code>VOTE_FLAG_BATCH</code>
+ * @param result  Le resultat, a liberer avec vote_result_free()
+ * @return  <code>VOTE_OK</code> ou un code d'erreur,
+ *          <code>VOTE_ERROR_INVALID</code> si un classement repete une glace
+ *          et que le systeme n'est pas <code>VOTE_TWO_ROUND</code>
+ */
+VOTE_API vote_status vote_run(vote_ballot const *ballot, vote_system system,
+                              unsigned flags, vote_result **result);
+
+/**
+ * Libere un resultat. Un pointeur nul est ignore.
+ *
+ * @param result  Le resultat
+ */
+VOTE_API void vote_result_free(vote_result *result);
+
+/**
+ * Nombre de tours d'un resultat
+ *
+ * @param result  Le resultat
+ * @return  Le nombre de tours
+ */
+VOTE_API size_t vote_result_round_count(vote_result const *result);
+
+/**
+ * Etat de toutes les glaces a la fin d'un tour
+ *
+ * @param result  Le resultat
+ * @param round   Le tour, a partir de 0
+ * @param count   Nombre de glaces renvoyees
+ * @return  Les glaces dans l'ordre de leurs identifiants, valables jusqu'a
+ *          vote_result_free(), ou un pointeur nul si le tour n'existe pas
+ */
+VOTE_API vote_tally const *vote_result_round(vote_result const *result,
+                                             size_t round, size_t *count);
+
+/**
+ * Glaces gagnantes d'un resultat
+ *
+ * @param result   Le resultat
+ * @param winners  Identifiants des glaces gagnantes, valables jusqu'a
+ *                 vote_result_free()
+ * @return  Nombre de glaces gagnantes
+ */
+VOTE_API size_t vote_result_winners(vote_result const *result,
+                                    int32_t const    **winners);
+
+/**
+ * Reports de voix d'un resultat, dans l'ordre des tours
+ *
+ * @param result     Le resultat
+ * @param transfers  Les reports, valables jusqu'a vote_result_free()
+ * @return  Nombre de reports
+ */
+VOTE_API size_t vote_result_transfers(vote_result const    *result,
+                                      vote_transfer const **transfers);
+
+/**
+ * Nom d'une glace d'un vote
+ *
+ * @param ballot  Le vote
+ * @param id      Identifiant de la glace
+ * @return  Le nom, valable jusqu'a vote_ballot_free(), ou un pointeur nul si
+ *          la glace n'existe pas
+ */
+VOTE_API char const *vote_ballot_candidate_name(vote_ballot const *ballot,
+                                                int32_t            id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
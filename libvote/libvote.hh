@@ -5,7 +5,12 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 typedef int8_t    i8;
@@ -57,19 +62,400 @@ struct candidate {
  */
 struct participant {
 	/**
-	 * Nom de famille du participant
+	 * Position du nom de famille, suivi du prenom, dans
+	 * <code>roll.names</code>
 	 */
-	std::string last_name;
+	usize name;
 	/**
-	 * Prenom du participant
+	 * Longueur du nom de famille du participant
 	 */
-	std::string first_name;
+	u32 last_name_size;
 	/**
-	 * Les identifiants des glaces pour lesquels le participant a vote
+	 * Longueur du prenom du participant
+	 */
+	u32 first_name_size;
+	/**
+	 * Position du premier vote du participant dans <code>roll.votes</code>
+	 */
+	usize first_vote;
+	/**
+	 * Nombre de glaces pour lesquelles le participant a vote
+	 */
+	u32 vote_count;
+	/**
+	 * Ligne de l'entree ou commence le participant, a partir de 1, ou 0 si
+	 * elle n'est pas connue (cache, interface C, serveur)
+	 */
+	u32 line;
+};
+
+/**
+ * Structure representant la liste des participants d'un vote. Les noms des
+ * participants ne servent a aucun systeme de votes : ils sont tous stockes a
+ * la suite dans une seule chaine de caracteres, ou pas du tout si la liste est
+ * anonyme. De meme, les classements de tous les participants sont mis bout a
+ * bout dans un seul vecteur, qui est libere d'un coup avec la liste.
+ */
+struct roll {
+	/**
+	 * Tous les participants
+	 */
+	std::vector<struct participant> participants;
+	/**
+	 * Les identifiants des glaces pour lesquelles les participants ont vote,
+	 * dans l'ordre des participants puis de leurs classements
 	 */
 	std::vector<i32> votes;
+	/**
+	 * Les noms et prenoms de tous les participants mis bout a bout
+	 */
+	std::string names;
+	/**
+	 * Si la liste est anonyme, les noms des participants sont ignores lors
+	 * de la lecture et <code>names</code> reste vide
+	 */
+	bool anonymous;
+};
+
+/**
+ * Classement d'un participant
+ *
+ * @param roll         La liste des participants
+ * @param participant  Le participant
+ * @return  Pointeur vers les <code>participant.vote_count</code> identifiants
+ *          des glaces pour lesquelles le participant a vote
+ */
+inline i32 const *get_votes(struct roll const        &roll,
+                            struct participant const &participant) {
+	return roll.votes.data() + participant.first_vote;
+}
+
+/**
+ * Nom de famille d'un participant
+ *
+ * @param roll         La liste des participants
+ * @param participant  Le participant
+ * @return  Le nom de famille, vide si la liste est anonyme
+ */
+inline std::string get_last_name(struct roll const        &roll,
+                                 struct participant const &participant) {
+	return roll.names.substr(participant.name, participant.last_name_size);
+}
+
+/**
+ * Prenom d'un participant
+ *
+ * @param roll         La liste des participants
+ * @param participant  Le participant
+ * @return  Le prenom, vide si la liste est anonyme
+ */
+inline std::string get_first_name(struct roll const        &roll,
+                                  struct participant const &participant) {
+	return roll.names.substr(participant.name + participant.last_name_size,
+	                         participant.first_name_size);
+}
+
+/**
+ * Morceau de classements deverses sur disque, voir <code>spill</code>
+ */
+struct chunk {
+	/**
+	 * Position du morceau dans le fichier
+	 */
+	u64 offset;
+	/**
+	 * Nombre de participants du morceau
+	 */
+	usize participants;
+	/**
+	 * Nombre total d'identifiants du morceau
+	 */
+	usize votes;
+	/**
+	 * Nombre de glaces classees par chaque participant du morceau si c'est le
+	 * meme pour tous, 0 sinon. Dans le second cas, le morceau commence par la
+	 * longueur de chaque classement sur 4 octets.
+	 */
+	u32 length;
+};
+
+/**
+ * Classements deverses dans un fichier temporaire, pour les votes qui ne
+ * tiennent pas en memoire. Le fichier est supprime des sa creation et ferme
+ * avec la structure : il ne survit pas au programme. Il est relu
+ * sequentiellement, morceau par morceau, a chaque tour (voir disk::scan()).
+ */
+struct spill {
+	/**
+	 * Descripteur du fichier temporaire
+	 */
+	int fd;
+	/**
+	 * Memoire qu'un morceau peut occuper une fois relu, en octets
+	 */
+	usize chunk_size;
+	/**
+	 * Nombre de glaces, pour verifier les identifiants
+	 */
+	usize candidate_count;
+	/**
+	 * Indique que les glaces classees deux fois sont refusees, voir
+	 * tally::find_invalid()
+	 */
+	bool unique;
+	/**
+	 * Taille en octets d'un identifiant de glace, comme
+	 * <code>ranks.width</code>
+	 */
+	u32 width;
+	/**
+	 * Longueur commune a tous les classements, comme
+	 * <code>ranks.length</code>
+	 */
+	u32 length;
+	/**
+	 * Nombre total de participants
+	 */
+	usize participants;
+	/**
+	 * Taille du fichier
+	 */
+	u64 size;
+	/**
+	 * Tous les morceaux ecrits, dans l'ordre des participants
+	 */
+	std::vector<struct chunk> chunks;
+	/**
+	 * Longueurs des classements du morceau en cours d'ecriture
+	 */
+	std::vector<u32> pending_counts;
+	/**
+	 * Identifiants du morceau en cours d'ecriture, sur <code>width</code>
+	 * octets chacun
+	 */
+	std::vector<u8> pending_ids;
+
+	spill();
+	spill(struct spill const &) = delete;
+	~spill();
+};
+
+/**
+ * Structure representant les classements de tous les participants sous une
+ * forme compacte pour les systemes de votes. Les identifiants des glaces sont
+ * stockes dans le plus petit type entier qui peut tous les contenir, et
+ * seul le vecteur correspondant a <code>width</code> est utilise.
+ *
+ * Avec moins de 16 glaces, chaque classement d'au plus 16 glaces est plutot
+ * range dans un seul mot : une glace tous les 4 bits, en commencant par les
+ * bits de poids faible, puis des 0. Le premier choix non elimine se trouve
+ * alors avec une table indexee par un octet du mot, sans passer par la liste
+ * des participants meme si les classements n'ont pas tous la meme longueur.
+ */
+struct ranks {
+	/**
+	 * Taille en octets d'un identifiant de glace : 1, 2 ou 4
+	 */
+	u32 width;
+	/**
+	 * Taille en octets d'un classement compact : 2, 4 ou 8 selon le plus long
+	 * classement, ou 0 si les classements ne sont pas compacts. Seul le
+	 * vecteur de mots correspondant est alors utilise et les vecteurs
+	 * d'identifiants sont vides.
+	 */
+	u32 word;
+	/**
+	 * Nombre de glaces classees par chaque participant si c'est le meme pour
+	 * tous, 0 sinon. Dans le premier cas, le classement du participant
+	 * <code>i</code> commence a la position <code>i * length</code>.
+	 */
+	u32 length;
+	/**
+	 * Identifiants sur 1 octet (moins de 256 glaces)
+	 */
+	std::vector<u8> ids8;
+	/**
+	 * Identifiants sur 2 octets (moins de 65536 glaces)
+	 */
+	std::vector<u16> ids16;
+	/**
+	 * Identifiants sur 4 octets
+	 */
+	std::vector<u32> ids32;
+	/**
+	 * Classements compacts d'au plus 4 glaces, un mot par participant
+	 */
+	std::vector<u16> words16;
+	/**
+	 * Classements compacts d'au plus 8 glaces
+	 */
+	std::vector<u32> words32;
+	/**
+	 * Classements compacts d'au plus 16 glaces
+	 */
+	std::vector<u64> words64;
+	/**
+	 * Si les classements ont ete deverses sur disque, le fichier qui les
+	 * contient ; les vecteurs d'identifiants sont alors vides et la liste des
+	 * participants aussi
+	 */
+	std::shared_ptr<struct spill const> spill;
+};
+
+/**
+ * Participant refuse lors de la verification des classements
+ */
+struct rejection {
+	/**
+	 * Indice du participant dans <code>roll.participants</code>
+	 */
+	usize participant;
+	/**
+	 * Ligne du participant, voir <code>participant.line</code>
+	 */
+	u32 line;
+	/**
+	 * Rang de l'identifiant refuse dans le classement, a partir de 1
+	 */
+	u32 rank;
+	/**
+	 * L'identifiant refuse
+	 */
+	i32 id;
+	/**
+	 * Indique que la glace etait deja classee plus haut, sinon l'identifiant
+	 * ne correspond a aucune glace
+	 */
+	bool duplicate;
+};
+
+/**
+ * Resultat de la verification des classements par get_ballot()
+ */
+struct validation {
+	/**
+	 * Nombre de participants refuses
+	 */
+	usize rejected;
+	/**
+	 * Les premiers participants refuses, dans l'ordre de la liste
+	 */
+	std::vector<struct rejection> rejections;
+};
+
+/**
+ * Decomptes du premier tour calcules a l'avance, par exemple pendant la
+ * lecture de l'entree (voir pipeline::parse()). Les noyaux de depouillement
+ * les reutilisent au lieu de relire les participants. Un vecteur vide n'a pas
+ * ete calcule.
+ */
+struct first_round {
+	/**
+	 * Voix en premiere place de chaque glace, indexees par identifiant
+	 */
+	std::vector<usize> votes;
+	/**
+	 * Voix en derniere place de chaque glace, indexees par identifiant
+	 */
+	std::vector<usize> last_votes;
+	/**
+	 * Matrice des paires de votes, voir tally::count_pairs()
+	 */
+	std::vector<usize> pairs;
+};
+
+/**
+ * Decision anticipee du premier tour, voir pipeline::decide()
+ */
+struct decision {
+	/**
+	 * Nombre total de participants annonce avant la lecture
+	 */
+	usize total;
+	/**
+	 * Glace qui a deja plus de la moitie des voix de <code>total</code>
+	 * participants au premier tour, 0 si le vote n'a pas pu etre decide
+	 * avant la fin de l'entree
+	 */
+	i32 winner;
+	/**
+	 * Nombre de participants comptes au moment de la decision, c'est-a-dire
+	 * jusqu'au participant qui l'a rendue certaine
+	 */
+	usize counted;
+};
+
+/**
+ * Decomptes d'un tour pour un ensemble donne de glaces non eliminees. Un
+ * vecteur vide n'a pas ete calcule.
+ */
+struct checkpoint {
+	/**
+	 * Voix en premiere place de chaque glace, indexees par identifiant
+	 */
+	std::vector<usize> votes;
+	/**
+	 * Voix en derniere place de chaque glace, indexees par identifiant
+	 */
+	std::vector<usize> last_votes;
+	/**
+	 * Reports de voix (voir tally::count_transfers()), indexes par les
+	 * identifiants des glaces qui viennent d'etre eliminees
+	 */
+	std::map<std::vector<i32>, std::vector<usize>> transfers;
+};
+
+/**
+ * Decomptes de tous les tours deja comptes sur les memes participants. Les
+ * decomptes d'un tour ne dependent que des glaces non eliminees : un vote qui
+ * retrouve le meme ensemble de glaces qu'un vote precedent reprend ses
+ * decomptes sans relire les participants (voir analysis::withdraw()).
+ */
+struct checkpoints {
+	/**
+	 * Les decomptes, indexes par l'etat de chaque glace : un octet par
+	 * identifiant, non nul si la glace n'est pas eliminee
+	 */
+	std::unordered_map<std::string, struct checkpoint> rounds;
+	/**
+	 * Nombre de depouillements qui ont du relire les participants
+	 */
+	usize scans;
 };
 
+/**
+ * Report des voix d'une glace eliminee, pour les systemes de votes qui
+ * eliminent des glaces tour apres tour
+ */
+struct transfer {
+	/**
+	 * Le tour qui compte les voix reportees
+	 */
+	u32 round;
+	/**
+	 * Identifiant de la glace eliminee
+	 */
+	i32 from;
+	/**
+	 * Identifiant de la glace qui recoit les voix, 0 pour les participants
+	 * qui n'ont classe aucune autre glace encore en lice
+	 */
+	i32 to;
+	/**
+	 * Nombre de participants dont la voix est reportee
+	 */
+	usize votes;
+};
+
+/**
+ * Fonction appelee a la fin de chaque tour d'un vote, voir
+ * <code>ballot.observer</code>
+ *
+ * @param ballot  Le vote, tel qu'il serait affiche par print_vote()
+ * @param data    Donnees de l'appelant, <code>ballot.observer_data</code>
+ */
+typedef void (*round_observer)(struct ballot const &ballot, void *data);
+
 /**
  * Structure representant un vote organise avec des glaces et des
  * participants ayant votes pour ces glaces
@@ -80,9 +466,22 @@ struct ballot {
 	 */
 	std::vector<struct candidate> candidates;
 	/**
-	 * Tous les participants du vote
+	 * Tous les participants du vote. Ils ne sont jamais modifies par les
+	 * systemes de votes et peuvent donc etre partages entre plusieurs votes.
+	 * Leurs votes sont deplaces dans <code>ranks</code> : le vecteur
+	 * <code>roll->votes</code> est vide.
 	 */
-	std::vector<struct participant> participants;
+	std::shared_ptr<struct roll const> roll;
+	/**
+	 * Les classements des participants, partages comme <code>roll</code>
+	 */
+	std::shared_ptr<struct ranks const> ranks;
+	/**
+	 * Indices des participants a compter (par exemple un reechantillonnage).
+	 * Un meme indice peut apparaitre plusieurs fois. Si le vecteur est vide,
+	 * tous les participants sont comptes une fois.
+	 */
+	std::vector<u32> sample;
 	/**
 	 * Glace gagnantes
 	 */
@@ -92,20 +491,125 @@ struct ballot {
 	 * ce nombre deviendra le nombre total de tours effectues.
 	 */
 	u32 round;
+	/**
+	 * Pour le vote alternatif : elimine en un seul tour toutes les glaces qui
+	 * ne peuvent plus mathematiquement gagner au lieu d'une seule
+	 */
+	bool batch;
+	/**
+	 * Les tours pendant lesquels plusieurs glaces ont ete eliminees d'un
+	 * coup (voir <code>batch</code>)
+	 */
+	std::vector<u32> collapsed;
+	/**
+	 * Pour le vote alternatif et le vote preferentiel : les reports de voix de
+	 * chaque tour, comptes pendant le depouillement du tour, dans l'ordre des
+	 * tours puis des glaces eliminees et des glaces qui les recoivent
+	 */
+	std::vector<struct transfer> transfers;
+	/**
+	 * Indique si les tours du vote doivent etre affiches
+	 */
+	bool verbose;
+	/**
+	 * Si elle n'est pas nulle, fonction appelee a chaque tour par
+	 * print_vote(), meme si <code>verbose</code> est desactive : elle permet
+	 * de garder le detail des tours sans passer par l'affichage
+	 */
+	round_observer observer;
+	/**
+	 * Donnees passees a <code>observer</code>
+	 */
+	void *observer_data;
+	/**
+	 * Premier tour deja compte, ignore si on compte un echantillon
+	 */
+	struct first_round first_round;
+	/**
+	 * S'il n'est pas nul, decomptes des tours deja comptes, completes a
+	 * chaque tour et partages entre les copies du vote. Ils sont ignores si
+	 * on compte un echantillon et ne doivent pas etre partages entre fils
+	 * d'execution.
+	 */
+	std::shared_ptr<struct checkpoints> checkpoints;
 };
 
 /**
- * Initialise une structure de vote pour pouvoir commencer un vote
+ * Initialise une structure de vote pour pouvoir commencer un vote.
+ * Les arguments sont pris par valeur : on peut les deplacer avec
+ * <code>std::move</code> pour eviter de les copier.
  *
- * @param candidates    Les glaces
- * @param participants  Les participants du vote
- * @param ballot  Le vote
+ * @param candidates  Les glaces
+ * @param roll        Les participants du vote
+ * @param ballot      Le vote
  * @return  Valeur booleenne indiquant si la structure a ete cree ou s'il
  *          y a eu une erreur
  */
-bool get_ballot(std::vector<struct candidate>   candidates,
-                std::vector<struct participant> participants,
-                struct ballot                  &ballot);
+bool get_ballot(std::vector<struct candidate> candidates, struct roll roll,
+                struct ballot &ballot);
+
+/**
+ * Initialise une structure de vote comme get_ballot(), en gardant les
+ * participants refuses : un identifiant qui ne correspond a aucune glace ou,
+ * pour un vote par classement, une glace classee deux fois par le meme
+ * participant. Le vote majoritaire lit le choix de chaque tour a la suite et
+ * peut donc repeter une glace.
+ *
+ * @param candidates  Les glaces
+ * @param roll        Les participants du vote
+ * @param ballot      Le vote
+ * @param unique      Indique qu'une glace ne peut etre classee qu'une fois
+ * @param validation  Les participants refuses
+ * @return  Valeur booleenne indiquant si la structure a ete creee, c'est a
+ *          dire qu'aucun participant n'a ete refuse
+ */
+bool get_ballot(std::vector<struct candidate> candidates, struct roll roll,
+                struct ballot &ballot, bool unique,
+                struct validation &validation);
+
+/**
+ * Initialise une structure de vote dont les classements ont ete deverses sur
+ * disque par pipeline::parse(). La liste des participants est vide et ne peut
+ * pas etre reechantillonnee.
+ *
+ * @param candidates  Les glaces
+ * @param spill       Les classements deverses
+ * @param ballot      Le vote
+ * @return  Valeur booleenne indiquant si la structure a ete creee
+ */
+bool get_ballot(std::vector<struct candidate>       candidates,
+                std::shared_ptr<struct spill const> spill,
+                struct ballot                      &ballot);
+
+/**
+ * Nombre de participants comptes dans un vote
+ *
+ * @param ballot  Le vote
+ * @return  La taille de l'echantillon s'il y en a un, sinon le nombre total de
+ *          participants
+ */
+inline usize participant_count(struct ballot const &ballot) {
+	if (!ballot.sample.empty()) {
+		return ballot.sample.size();
+	}
+
+	return ballot.ranks->spill ? ballot.ranks->spill->participants
+	                           : ballot.roll->participants.size();
+}
+
+/**
+ * Accede a un participant compte dans un vote, en passant par l'echantillon
+ * s'il y en a un
+ *
+ * @param ballot  Le vote
+ * @param i       Indice entre 0 et <code>participant_count(ballot)</code>
+ * @return  Le participant
+ */
+inline struct participant const &get_participant(struct ballot const &ballot,
+                                                 usize                i) {
+	return ballot.roll
+		->participants[ballot.sample.empty() ? i : ballot.sample[i]];
+}
 
 /**
  * Trouve une glace dans une structure de vote a l'aide de son identifiant
@@ -136,7 +640,8 @@ bool is_winner(struct ballot const &ballot, i32 candidate_id);
 bool is_eliminated(struct ballot &ballot, i32 candidate_id);
 
 /**
- * Affiche un vote en cours.
+ * Affiche un vote en cours, et le transmet a <code>ballot.observer</code>
+ * s'il y en a un.
  *
  * @param ballot  Le vote a afficher
  */
@@ -184,6 +689,36 @@ namespace parser {
  */
 bool read_string(std::istream &stream, std::string &string);
 
+/**
+ * Lit une chaine de caracteres comme read_string(), en comptant les lignes
+ * lues, y compris les lignes ignorees
+ *
+ * @param stream  Flux d'entree
+ * @param string  La chaine de caracteres
+ * @param line    Numero de la derniere ligne lue
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+bool read_string(std::istream &stream, std::string &string, usize &line);
+
+/**
+ * Convertit une ligne en entier, comme <code>std::stoi</code> mais sans
+ * exception
+ *
+ * @param string   La ligne
+ * @param integer  L'entier renvoye
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+bool to_int(std::string const &string, i32 &integer);
+
+/**
+ * Determine si une ligne ressemble a un nom de famille (aucune minuscule),
+ * ce qui marque la fin des glaces et le debut des participants
+ *
+ * @param string  La ligne
+ * @return  Valeur booleenne indiquant si la ligne est un nom de famille
+ */
+bool is_last_name(std::string const &string);
+
 /**
  * Lit un entier.
  * Meme remarques que la fonction parse_string.
@@ -211,49 +746,218 @@ bool parse_candidates(std::istream                  &stream,
 
 /**
  * Traite les noms de participants contenus dans un flux. Si le format est
- * incorrect, la fonction echoue.
+ * incorrect, la fonction echoue. Les noms ne sont pas conserves si
+ * <code>roll.anonymous</code> est active. Les lignes des participants sont
+ * comptees depuis le debut du flux.
  *
- * @param stream        Flux d'entree
- * @param participants  Vecteur de sortie
- * @param count         Nombre de participants a traiter. S'il est 0, on traite
- *                      les lignes suivantes jusqu'a la fin du flux.
+ * @param stream  Flux d'entree
+ * @param roll    Liste de sortie
+ * @param count   Nombre de participants a traiter. S'il est 0, on traite
+ *                les lignes suivantes jusqu'a la fin du flux.
  * @return  Valeur booleenne indicative du succes de la fonction
  */
-bool parse_participants(std::istream                    &stream,
-                        std::vector<struct participant> &participants,
-                        usize                            count);
+bool parse_participants(std::istream &stream, struct roll &roll, usize count);
 } // namespace parser
 
 /**
- * Systemes de votes
+ * Noyaux de depouillement. Chaque fonction est specialisee a la compilation
+ * selon la taille des identifiants et selon que les classements ont tous la
+ * meme longueur ou non ; la bonne specialisation est choisie a l'execution
+ * d'apres <code>ballot.ranks</code>. Les voix sont renvoyees dans un vecteur
+ * indexe par l'identifiant des glaces (l'indice 0 n'est pas utilise).
+ * Si les classements ont ete deverses sur disque, les noyaux sont appliques
+ * morceau par morceau pendant une lecture sequentielle du fichier, et peuvent
+ * lever <code>std::ios_base::failure</code> si elle echoue.
  */
-namespace algorithm {
+namespace tally {
 /**
- * Commence un tour d'un vote en reinitialisant toutes les voix des glaces
- * qui ne sont pas encore eliminees pour les recompter
+ * Cherche le premier identifiant invalide d'un classement : un identifiant
+ * qui ne correspond a aucune glace, ou une glace deja classee
  *
- * @param ballot  Le vote
+ * @param ranking          Le classement
+ * @param count            Longueur du classement
+ * @param candidate_count  Nombre de glaces
+ * @param seen             Ensemble de <code>candidate_count / 64 + 1</code>
+ *                         mots de bits a zero, remis a zero en sortie
+ * @return  Rang du premier identifiant invalide, a partir de 0, ou
+ *          <code>count</code> si le classement est valide
  */
-void begin_round(struct ballot &ballot);
+u32 find_invalid(i32 const *ranking, u32 count, usize candidate_count,
+                 u64 *seen);
 
 /**
- * Calcule le pourcentage des voix qu'une glace possede
+ * Compte un participant refuse, en gardant seulement les premiers
  *
- * @param ballot     Le vote
- * @param candidate  La glace
- * @return  Nombre flottant normalise entre 0 et 1
+ * @param validation       Les participants refuses
+ * @param participant      Indice du participant
+ * @param line             Ligne du participant, 0 si elle est inconnue
+ * @param ranking          Son classement
+ * @param rank             Rang de l'identifiant refuse, a partir de 0
+ * @param candidate_count  Nombre de glaces
  */
-double get_vote_fraction(struct ballot          &ballot,
-                         struct candidate const &candidate);
+void reject(struct validation &validation, usize participant, u32 line,
+            i32 const *ranking, u32 rank, usize candidate_count);
 
 /**
- * Systeme de votes majoritaire 2 tours.
+ * Ajoute les participants refuses d'une autre validation, dont les indices
+ * suivent ceux de <code>validation</code>
  *
- * @param ballot  Le vote
- * @return  Valeur booleenne indiquant que le systeme de votes a ete
- *          effectue avec succes
+ * @param validation  Les participants refuses
+ * @param other       Les participants refuses a ajouter
  */
-bool two_round(struct ballot &ballot);
+void merge(struct validation &validation, struct validation const &other);
+
+/**
+ * Compacte les votes d'une liste de participants en verifiant leurs
+ * classements dans le meme passage, en parallele pour les grandes listes
+ *
+ * @param roll             La liste des participants
+ * @param candidate_count  Nombre de glaces
+ * @param unique           Indique que les glaces classees deux fois sont
+ *                         refusees, voir find_invalid()
+ * @param ranks            Les classements compactes
+ * @param validation       Les participants refuses
+ * @return  Valeur booleenne indiquant que tous les classements sont valides
+ */
+bool get_ranks(struct roll const &roll, usize candidate_count, bool unique,
+               struct ranks &ranks, struct validation &validation);
+
+/**
+ * Identifiants de classements compacts, dans l'ordre des participants
+ *
+ * @param roll   La liste des participants
+ * @param ranks  Les classements, avec <code>ranks.word</code> non nul
+ * @return  Les identifiants sur 1 octet
+ */
+std::vector<u8> unpack(struct roll const &roll, struct ranks const &ranks);
+
+/**
+ * Compte pour chaque glace les participants qui la classent en premier parmi
+ * les glaces non eliminees
+ *
+ * @param ballot  Le vote
+ * @param votes   Les voix de chaque glace
+ */
+void count_first(struct ballot const &ballot, std::vector<usize> &votes);
+
+/**
+ * Comme count_first(), mais compte aussi dans la meme passe les participants
+ * dont la voix quitte une glace qui vient d'etre eliminee : leur premier
+ * choix parmi les glaces non eliminees et celles de
+ * <code>eliminated</code>
+ *
+ * @param ballot      Le vote, ou les glaces de <code>eliminated</code> sont
+ *                    deja eliminees
+ * @param eliminated  Identifiants des glaces eliminees depuis le dernier
+ *                    depouillement
+ * @param votes       Les voix de chaque glace
+ * @param transfers   Matrice de <code>eliminated.size()</code> lignes et
+ *                    <code>n + 1</code> colonnes, ou <code>n</code> est le
+ *                    nombre de glaces : la case <code>i * (n + 1) + id</code>
+ *                    contient le nombre de voix reportees de
+ *                    <code>eliminated[i]</code> vers <code>id</code>, ou
+ *                    vers aucune glace si <code>id</code> est 0
+ */
+void count_transfers(struct ballot const    &ballot,
+                     std::vector<i32> const &eliminated,
+                     std::vector<usize>     &votes,
+                     std::vector<usize>     &transfers);
+
+/**
+ * Compte pour chaque glace les participants qui la classent en dernier parmi
+ * les glaces non eliminees
+ *
+ * @param ballot  Le vote
+ * @param votes   Les voix de chaque glace
+ */
+void count_last(struct ballot const &ballot, std::vector<usize> &votes);
+
+/**
+ * Compte pour chaque glace non eliminee les participants qui l'ont classee a
+ * un rang donne
+ *
+ * @param ballot  Le vote
+ * @param rank    Le rang, a partir de 0
+ * @param votes   Les voix de chaque glace
+ */
+void count_rank(struct ballot const &ballot, u32 rank,
+                std::vector<usize> &votes);
+
+/**
+ * Compte en une seule passe, pour des classements de longueur 2, les
+ * participants selon leur vote du premier tour et celui du second tour. Les
+ * gros votes sont comptes en parallele.
+ *
+ * @param ballot  Le vote
+ * @param matrix  Matrice carree de cote <code>n + 1</code>, ou
+ *                <code>n</code> est le nombre de glaces : la case
+ *                <code>first * (n + 1) + second</code> contient le nombre de
+ *                participants ayant vote <code>first</code> puis
+ *                <code>second</code>. Elle reste nulle si les classements
+ *                ne sont pas de longueur 2.
+ */
+void count_pairs(struct ballot const &ballot, std::vector<usize> &matrix);
+} // namespace tally
+
+/**
+ * Systemes de votes
+ */
+namespace algorithm {
+/**
+ * Commence un tour d'un vote en reinitialisant toutes les voix des glaces
+ * qui ne sont pas encore eliminees pour les recompter
+ *
+ * @param ballot  Le vote
+ */
+void begin_round(struct ballot &ballot);
+
+/**
+ * Compte pour chaque glace les participants qui la classent en premier parmi
+ * les glaces non eliminees, et ajoute a <code>ballot.transfers</code> les
+ * reports de voix des glaces qui viennent d'etre eliminees
+ *
+ * @param ballot      Le vote
+ * @param eliminated  Identifiants des glaces eliminees depuis le dernier
+ *                    depouillement
+ * @param votes       Les voix de chaque glace
+ */
+void count_first(struct ballot &ballot, std::vector<i32> const &eliminated,
+                 std::vector<usize> &votes);
+
+/**
+ * Calcule le pourcentage des voix qu'une glace possede
+ *
+ * @param ballot     Le vote
+ * @param candidate  La glace
+ * @return  Nombre flottant normalise entre 0 et 1
+ */
+double get_vote_fraction(struct ballot          &ballot,
+                         struct candidate const &candidate);
+
+/**
+ * Systeme de votes majoritaire 2 tours.
+ * Les participants ne sont lus qu'une fois pour les deux tours, voir
+ * tally::count_pairs().
+ *
+ * @param ballot  Le vote
+ * @return  Valeur booleenne indiquant que le systeme de votes a ete
+ *          effectue avec succes
+ */
+bool two_round(struct ballot &ballot);
+
+/**
+ * Second tour du vote majoritaire entre deux glaces quelconques, sans relire
+ * les participants
+ *
+ * @param ballot   Le vote
+ * @param matrix   La matrice renvoyee par tally::count_pairs()
+ * @param a        Identifiant de la premiere glace
+ * @param b        Identifiant de la seconde glace
+ * @param a_votes  Voix de la premiere glace
+ * @param b_votes  Voix de la seconde glace
+ */
+void runoff(struct ballot const &ballot, std::vector<usize> const &matrix,
+            i32 a, i32 b, usize &a_votes, usize &b_votes);
 
 /**
  * Systeme de votes preferentiel.
@@ -266,6 +970,9 @@ bool ranked(struct ballot &ballot);
 
 /**
  * Systeme de votes alternatif.
+ * Si <code>ballot.batch</code> est active, les glaces qui ne peuvent plus
+ * gagner sont eliminees ensemble et les tours concernes sont ajoutes a
+ * <code>ballot.collapsed</code>.
  *
  * @param ballot  Le vote
  * @return  Valeur booleenne indiquant que le systeme de votes a ete
@@ -274,6 +981,785 @@ bool ranked(struct ballot &ballot);
 bool instant_runoff(struct ballot &ballot);
 } // namespace algorithm
 
+/**
+ * Analyse de la robustesse des resultats
+ */
+namespace analysis {
+/**
+ * Un systeme de votes de l'espace de nommage <code>algorithm</code>
+ */
+typedef bool (*system)(struct ballot &ballot);
+
+/**
+ * Reechantillonne les participants avec remise (bootstrap) et applique un
+ * systeme de votes sur chaque echantillon. Les echantillons ne copient pas les
+ * participants, seulement leurs indices. Le resultat ne depend que de la
+ * graine, et pas du nombre de fils d'execution.
+ *
+ * @param ballot   Le vote d'origine, initialise avec get_ballot()
+ * @param system   Le systeme de votes
+ * @param samples  Nombre d'echantillons
+ * @param seed     Graine du generateur de nombres pseudo-aleatoires
+ * @param jobs     Nombre de fils d'execution. S'il est 0, on utilise tous les
+ *                 coeurs disponibles.
+ * @param wins     Nombre de victoires de chaque glace, indexe par
+ *                 <code>id - 1</code>
+ * @return  Valeur booleenne indiquant que le systeme de votes a reussi sur
+ *          tous les echantillons. Un vote de plus de
+ *          <code>UINT32_MAX</code> participants est refuse, comme
+ *          <code>ballot.sample</code> garde des indices sur 32 bits.
+ */
+bool bootstrap(struct ballot const &ballot, system system, usize samples,
+               u64 seed, usize jobs, std::vector<usize> &wins);
+
+/**
+ * Applique un systeme de votes comme si des glaces s'etaient retirees : elles
+ * sont eliminees avant le premier tour et leurs voix vont directement au
+ * choix suivant. Si <code>ballot.checkpoints</code> n'est pas nul, chaque
+ * tour qui retrouve les glaces non eliminees d'un tour deja compte reprend
+ * ses decomptes : seuls les premiers tours apres le retrait relisent les
+ * participants. Le vote majoritaire ne tient pas compte des glaces
+ * eliminees avant le premier tour et n'est pas pris en charge.
+ *
+ * @param ballot     Le vote d'origine, avant tout systeme de votes
+ * @param system     Le systeme de votes
+ * @param withdrawn  Identifiants des glaces retirees
+ * @param result     Le vote apres le systeme de votes, qui partage les
+ *                   participants et les decomptes de <code>ballot</code>
+ * @return  Valeur booleenne indiquant que les glaces existent, qu'il en
+ *          reste au moins une et que le systeme de votes a reussi
+ */
+bool withdraw(struct ballot const &ballot, system system,
+              std::vector<i32> const &withdrawn, struct ballot &result);
+} // namespace analysis
+
+/**
+ * Election d'un district, voir <code>districts</code>
+ */
+struct district {
+	/**
+	 * Nom du district
+	 */
+	std::string name;
+	/**
+	 * Le vote du district, avec les participants de tous ses blocs
+	 */
+	struct ballot ballot;
+	/**
+	 * Voix de chaque glace au premier tour, indexees par identifiant, gardees
+	 * pendant le systeme de votes
+	 */
+	std::vector<usize> first_round;
+	/**
+	 * Indique que le systeme de votes a reussi
+	 */
+	bool success;
+};
+
+/**
+ * Elections par district. Les participants sont regroupes en blocs precedes
+ * du nom de leur district entre crochets :
+ *
+ * <pre>
+ * Choco
+ * Banane
+ *
+ * [Nord]
+ * DUPONT
+ * Jean
+ * 2
+ * 1
+ *
+ * [Sud]
+ * ...
+ * </pre>
+ *
+ * Les glaces sont toutes les lignes avant le premier district. Un district
+ * peut avoir plusieurs blocs, dont les participants sont reunis. Les blocs
+ * sont au format habituel, ou a un participant par ligne comme avec
+ * <code>rows</code>.
+ */
+namespace districts {
+/**
+ * Lit toute l'entree puis les participants de chaque district en parallele
+ *
+ * @param stream      Flux d'entree
+ * @param rows        Indique que les blocs ont un participant par ligne
+ * @param anonymous   Indique que les noms des participants sont ignores
+ * @param unique      Indique qu'une glace ne peut etre classee qu'une fois,
+ *                    voir get_ballot()
+ * @param jobs        Nombre de fils d'execution. S'il est 0, on utilise tous
+ *                    les coeurs disponibles.
+ * @param candidates  Les glaces
+ * @param districts   Les districts dans l'ordre de leur premier bloc, chacun
+ *                    initialise avec get_ballot()
+ * @param validation  Les participants refuses de tous les districts, avec
+ *                    leur indice dans l'entree
+ * @return  Valeur booleenne indiquant que l'entree a au moins une glace et un
+ *          district, que chaque district a au moins un participant et que
+ *          tous les classements sont valides
+ */
+bool parse(std::istream &stream, bool rows, bool anonymous, bool unique,
+           usize jobs, std::vector<struct candidate> &candidates,
+           std::vector<struct district> &districts,
+           struct validation            &validation);
+
+/**
+ * Applique un systeme de votes a chaque district, independamment et en
+ * parallele. Les tours ne sont pas affiches ; le premier tour de chaque
+ * district est garde dans <code>district.first_round</code>.
+ *
+ * @param districts  Les districts
+ * @param system     Le systeme de votes
+ * @param jobs       Nombre de fils d'execution. S'il est 0, on utilise tous
+ *                   les coeurs disponibles.
+ * @return  Valeur booleenne indiquant que le systeme de votes a reussi dans
+ *          tous les districts
+ */
+bool run(std::vector<struct district> &districts, analysis::system system,
+         usize jobs);
+
+/**
+ * Compte les sieges de chaque glace : un par district gagne
+ *
+ * @param districts  Les districts, apres run()
+ * @param seats      Nombre de sieges de chaque glace, indexe par identifiant
+ */
+void count_seats(std::vector<struct district> const &districts,
+                 std::vector<usize>                 &seats);
+
+/**
+ * Additionne les premiers tours de tous les districts, sans relire les
+ * participants
+ *
+ * @param districts  Les districts, apres run()
+ * @param votes      Voix nationales de chaque glace au premier tour, indexees
+ *                   par identifiant
+ */
+void count_first_round(std::vector<struct district> const &districts,
+                       std::vector<usize>                 &votes);
+} // namespace districts
+
+/**
+ * Lecture et depouillement simultanes de l'entree
+ */
+namespace pipeline {
+/**
+ * Lit un vote complet sans jamais revenir en arriere dans le flux, qui peut
+ * donc etre l'entree standard sans la copier en memoire. Un fil d'execution
+ * lit les participants par lots et les transmet par une file sans verrou au
+ * fil appelant, qui compte le premier tour pendant que l'entree arrive et
+ * range les participants dans la liste.
+ *
+ * @param stream       Flux d'entree
+ * @param candidates   Les glaces
+ * @param roll         La liste des participants. <code>roll.anonymous</code>
+ *                     est respecte.
+ * @param first_round  Le premier tour, a placer dans
+ *                     <code>ballot.first_round</code> apres get_ballot()
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+bool parse(std::istream &stream, std::vector<struct candidate> &candidates,
+           struct roll &roll, struct first_round &first_round);
+
+/**
+ * Comme l'autre version de parse(), mais les classements sont deverses dans
+ * un fichier temporaire au fur et a mesure de la lecture au lieu d'etre
+ * gardes en memoire, et les noms des participants sont ignores. La memoire
+ * utilisee ne depend alors que de <code>budget</code>.
+ *
+ * @param stream       Flux d'entree
+ * @param candidates   Les glaces
+ * @param budget       Memoire que peuvent occuper les classements relus, en
+ *                     octets
+ * @param unique       Indique qu'une glace ne peut etre classee qu'une fois,
+ *                     voir get_ballot()
+ * @param spill        Les classements deverses, a passer a get_ballot()
+ * @param validation   Les participants refuses, voir disk::append()
+ * @param first_round  Le premier tour
+ * @return  Valeur booleenne indicative du succes de la fonction, fausse aussi
+ *          si un participant a ete refuse
+ */
+bool parse(std::istream &stream, std::vector<struct candidate> &candidates,
+           usize budget, bool unique,
+           std::shared_ptr<struct spill const> &spill,
+           struct validation                   &validation,
+           struct first_round                  &first_round);
+
+/**
+ * Comme parse(), mais arrete la lecture des qu'une glace a plus de la moitie
+ * des voix de <code>decision.total</code> participants au premier tour : les
+ * participants qui restent ne peuvent plus changer le resultat, quel que soit
+ * le systeme de votes. La decision est verifiee apres chaque participant,
+ * elle est donc prise exactement au participant qui la rend certaine. Le
+ * reste de l'entree n'est pas verifie.
+ *
+ * @param stream       Flux d'entree
+ * @param candidates   Les glaces
+ * @param roll         La liste des participants, seulement ceux comptes si
+ *                     le vote a ete decide
+ * @param decision     La decision, avec <code>decision.total</code> deja
+ *                     defini
+ * @param first_round  Le premier tour des participants comptes
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+bool decide(std::istream &stream, std::vector<struct candidate> &candidates,
+            struct roll &roll, struct decision &decision,
+            struct first_round &first_round);
+} // namespace pipeline
+
+/**
+ * Lecture d'entrees avec un participant par ligne, au format CSV ou TSV :
+ *
+ * <pre>
+ * Choco
+ * Banane
+ * Mangue
+ *
+ * participant,rang1,rang2,rang3
+ * 1042,2,1,3
+ * 1043,3,1
+ * </pre>
+ *
+ * Les glaces sont donnees comme dans le format habituel, une par ligne, puis
+ * chaque ligne contenant un separateur (virgule ou tabulation, selon la
+ * premiere de ces lignes) est un participant : son identifiant, qui sert de
+ * nom de famille, suivi de son classement. Une premiere ligne dont le
+ * classement ne peut pas etre lu est un en-tete et est ignoree.
+ * L'identifiant peut etre entre guillemets ; les champs vides en fin de
+ * ligne sont ignores, ainsi que les lignes vides et les commentaires. Une
+ * glace ne peut donc pas contenir de virgule ni de tabulation : sa ligne
+ * serait prise pour le premier participant.
+ */
+namespace rows {
+/**
+ * Lit un vote complet par blocs, sans jamais revenir en arriere dans le flux :
+ * les lignes et les champs sont trouves avec <code>memchr()</code> et les
+ * classements sont ranges directement dans la liste, sans passer par des
+ * chaines de caracteres.
+ *
+ * @param stream      Flux d'entree
+ * @param candidates  Les glaces
+ * @param roll        La liste des participants. <code>roll.anonymous</code>
+ *                    est respecte.
+ * @return  Valeur booleenne indicative du succes de la fonction, fausse
+ *          aussi s'il n'y a aucun participant
+ */
+bool parse(std::istream &stream, std::vector<struct candidate> &candidates,
+           struct roll &roll);
+} // namespace rows
+
+/**
+ * Depouillement hors memoire des classements deverses sur disque
+ */
+namespace disk {
+/**
+ * Cree le fichier temporaire dans <code>TMPDIR</code>, ou dans
+ * <code>/tmp</code> par defaut
+ *
+ * @param budget           Memoire que peuvent occuper les classements
+ *                         relus, en octets. Deux morceaux sont en memoire
+ *                         pendant une lecture : le morceau compte et le
+ *                         suivant, lu a l'avance.
+ * @param candidate_count  Nombre de glaces
+ * @param unique           Indique qu'une glace ne peut etre classee qu'une
+ *                         fois, voir get_ballot()
+ * @param spill            Les classements deverses
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+bool create(usize budget, usize candidate_count, bool unique,
+            struct spill &spill);
+
+/**
+ * Ajoute des classements a la fin du fichier, en verifiant que tous les
+ * identifiants correspondent a une glace et, si <code>spill.unique</code> est
+ * active, qu'aucune glace n'est classee deux fois. Un participant refuse est
+ * compte dans <code>validation</code>, vide au premier appel, et n'est pas
+ * deverse.
+ *
+ * @param spill        Les classements deverses
+ * @param votes        Les identifiants de tous les classements mis bout a bout
+ * @param vote_counts  Longueur de chaque classement
+ * @param lines        Ligne de chaque participant, 0 si elle est inconnue
+ * @param validation   Les participants refuses
+ * @return  Valeur booleenne indiquant que le fichier a pu etre ecrit
+ */
+bool append(struct spill &spill, std::vector<i32> const &votes,
+            std::vector<u32> const &vote_counts, std::vector<u32> const &lines,
+            struct validation &validation);
+
+/**
+ * Ecrit le dernier morceau en cours
+ *
+ * @param spill  Les classements deverses
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+bool finish(struct spill &spill);
+
+/**
+ * Fonction appelee sur chaque morceau d'un vote deverse
+ */
+typedef std::function<void(struct ballot const &chunk)> visitor;
+
+/**
+ * Relit sequentiellement les classements d'un vote deverse sur disque. Chaque
+ * morceau est presente comme un petit vote en memoire avec ses propres
+ * <code>roll</code> et <code>ranks</code>, pendant que le morceau suivant est
+ * lu par un autre fil d'execution.
+ *
+ * @param ballot  Le vote, dont <code>ballot.ranks->spill</code> est defini
+ * @param visit   Fonction appelee sur chaque morceau, dans l'ordre
+ * @throw std::ios_base::failure  Si le fichier ne peut pas etre relu
+ */
+void scan(struct ballot const &ballot, visitor const &visit);
+} // namespace disk
+
+/**
+ * Lecture d'entrees eventuellement compressees
+ */
+namespace input {
+/**
+ * Format d'une entree
+ */
+enum format {
+	/**
+	 * Texte brut
+	 */
+	plain,
+	/**
+	 * Compressee avec gzip
+	 */
+	gzip,
+	/**
+	 * Compressee avec zstd
+	 */
+	zstd
+};
+
+/**
+ * Ouvre une entree qui peut etre compressee. Le format est detecte a l'aide
+ * des premiers octets et l'entree est decompressee au fur et a mesure de la
+ * lecture dans des tampons de taille fixe : la memoire utilisee ne depend pas
+ * de la taille de l'entree. Une entree compressee invalide ou tronquee met le
+ * flux renvoye dans l'etat <code>bad()</code>.
+ *
+ * @param source  Le flux d'entree, par exemple <code>std::cin</code>
+ * @param format  Le format detecte
+ * @return  Le flux decompresse, ou <code>nullptr</code> si le format n'est pas
+ *          pris en charge par cette version de la bibliotheque
+ */
+std::unique_ptr<std::istream> open(std::istream &source, enum format &format);
+
+/**
+ * Tampon de flux qui lit une zone memoire deja chargee sans la copier. On
+ * peut s'y deplacer avec <code>tellg()</code> et <code>seekg()</code>.
+ */
+struct memory : public std::streambuf {
+	/**
+	 * @param data  Debut de la zone memoire, qui doit survivre au tampon
+	 * @param size  Taille de la zone memoire
+	 */
+	memory(char const *data, usize size);
+
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+	                 std::ios_base::openmode which) override;
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+};
+} // namespace input
+
+/**
+ * Vote enregistre avec cache::save_ballot() et projete en memoire : le
+ * classement d'un participant est lu sans lire le reste du fichier, voir
+ * cache::get_ranking()
+ */
+struct ballot_file {
+	/**
+	 * Debut de la projection
+	 */
+	void const *map;
+	/**
+	 * Taille du fichier
+	 */
+	usize size;
+	/**
+	 * Empreinte de l'entree dont le vote a ete lu
+	 */
+	u64 key;
+	/**
+	 * Les glaces
+	 */
+	std::vector<struct candidate> candidates;
+	/**
+	 * Voix en premiere place de chaque glace, indexees par identifiant
+	 */
+	std::vector<usize> first_votes;
+	/**
+	 * Nombre de participants
+	 */
+	u64 participants;
+	/**
+	 * Longueur commune des classements, 0 si elle varie
+	 */
+	u32 length;
+	/**
+	 * Taille en octets d'un identifiant de glace
+	 */
+	u32 width;
+	/**
+	 * Longueur de chaque classement sur 4 octets, si <code>length</code> est
+	 * 0
+	 */
+	u8 const *vote_counts;
+	/**
+	 * Position du classement d'un participant sur 4096 sur 8 octets, si
+	 * <code>length</code> est 0
+	 */
+	u8 const *index;
+	/**
+	 * Identifiants de tous les classements sur <code>width</code> octets
+	 */
+	u8 const *ids;
+	/**
+	 * Nombre d'identifiants
+	 */
+	usize id_count;
+
+	ballot_file();
+	ballot_file(struct ballot_file const &) = delete;
+	~ballot_file();
+};
+
+/**
+ * Cache sur disque des votes deja lus et des resultats deja calcules. Les
+ * entrees sont nommees d'apres une empreinte du contenu de l'entree : une
+ * entree modifiee a une autre empreinte et ne retrouve jamais un ancien
+ * resultat. Un fichier de cache illisible, tronque ou d'une autre version est
+ * simplement ignore.
+ */
+namespace cache {
+/**
+ * Empreinte rapide de 64 bits d'une zone memoire (MurmurHash64A)
+ *
+ * @param data  Debut de la zone memoire
+ * @param size  Taille de la zone memoire
+ * @param seed  Graine, par exemple l'empreinte d'autres donnees a combiner
+ * @return  L'empreinte
+ */
+u64 hash(void const *data, usize size, u64 seed);
+
+/**
+ * Chemin d'un fichier de cache
+ *
+ * @param directory  Le dossier du cache
+ * @param key        L'empreinte qui identifie le fichier
+ * @param kind       Extension du fichier selon son contenu
+ * @return  Le chemin
+ */
+std::string get_path(std::string const &directory, u64 key, char const *kind);
+
+/**
+ * Enregistre les classements compacts d'un vote, sans les noms des
+ * participants
+ *
+ * @param path    Chemin du fichier
+ * @param key     Empreinte de l'entree, verifiee a la lecture
+ * @param ballot  Le vote, initialise avec get_ballot()
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+bool save_ballot(std::string const &path, u64 key,
+                 struct ballot const &ballot);
+
+/**
+ * Relit un vote enregistre avec save_ballot(). La liste des participants est
+ * anonyme et doit etre passee a get_ballot().
+ *
+ * @param path        Chemin du fichier
+ * @param key         Empreinte de l'entree
+ * @param candidates  Les glaces
+ * @param roll        Les participants
+ * @return  Valeur booleenne indiquant que le fichier existe et est valide
+ */
+bool load_ballot(std::string const &path, u64 key,
+                 std::vector<struct candidate> &candidates, struct roll &roll);
+
+/**
+ * Projette en memoire un vote enregistre avec save_ballot(), sans verifier
+ * l'empreinte de son entree ni lire ses classements
+ *
+ * @param path  Chemin du fichier
+ * @param file  Le vote projete
+ * @return  Valeur booleenne indiquant que le fichier existe et est valide
+ */
+bool open_ballot(std::string const &path, struct ballot_file &file);
+
+/**
+ * Lit le classement d'un participant d'un vote projete en memoire. Seules les
+ * pages qui le contiennent sont lues : au plus 4096 longueurs de classements
+ * et les identifiants du participant.
+ *
+ * @param file         Le vote projete
+ * @param participant  Indice du participant, a partir de 0
+ * @param ranking      Identifiants des glaces classees par le participant
+ * @return  Valeur booleenne indiquant que le participant existe
+ */
+bool get_ranking(struct ballot_file const &file, u64 participant,
+                 std::vector<i32> &ranking);
+
+/**
+ * Enregistre le resultat d'un vote tel qu'il a ete affiche
+ *
+ * @param path    Chemin du fichier
+ * @param key     Empreinte de l'entree et des options
+ * @param rounds  Les tours du vote, affiches sur la sortie d'erreur
+ * @param output  Le resultat, affiche sur la sortie standard
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+bool save_result(std::string const &path, u64 key, std::string const &rounds,
+                 std::string const &output);
+
+/**
+ * Relit un resultat enregistre avec save_result()
+ *
+ * @param path    Chemin du fichier
+ * @param key     Empreinte de l'entree et des options
+ * @param rounds  Les tours du vote
+ * @param output  Le resultat
+ * @return  Valeur booleenne indiquant que le fichier existe et est valide
+ */
+bool load_result(std::string const &path, u64 key, std::string &rounds,
+                 std::string &output);
+} // namespace cache
+
+/**
+ * Audit par sondage d'un vote deja depouille (methode BRAVO) : des bulletins
+ * papier tires au hasard sont compares au premier tour electronique, et le
+ * risque que la glace annoncee en tete du premier tour soit fausse diminue a
+ * chaque bulletin qui la confirme. Avec un vote a plusieurs tours, cette glace
+ * n'est pas forcement le gagnant.
+ */
+struct ballot_polling {
+	/**
+	 * Glace annoncee en tete du premier tour
+	 */
+	i32 winner;
+	/**
+	 * Pour chaque glace perdante, indexee par identifiant : part annoncee des
+	 * voix du gagnant parmi celles du gagnant et de cette glace. 0 pour le
+	 * gagnant.
+	 */
+	std::vector<double> shares;
+	/**
+	 * Rapport de vraisemblance de chaque glace perdante, indexe par
+	 * identifiant : le risque de l'audit face a cette glace est son inverse
+	 */
+	std::vector<double> ratios;
+	/**
+	 * Nombre de bulletins confirmes
+	 */
+	usize sampled;
+};
+
+/**
+ * Audits par sondage
+ */
+namespace audit {
+/**
+ * Tire un participant au hasard, avec remise. Le tirage ne depend que de la
+ * graine et de son rang : on peut en ajouter d'autres sans changer les
+ * premiers, en temps constant quel que soit le nombre de participants.
+ *
+ * @param seed          Graine du tirage
+ * @param n             Rang du tirage, a partir de 0
+ * @param participants  Nombre de participants
+ * @return  Indice du participant tire, entre 0 et
+ *          <code>participants - 1</code>
+ */
+u64 draw(u64 seed, u64 n, u64 participants);
+
+/**
+ * Commence un audit d'apres le premier tour annonce
+ *
+ * @param votes    Voix en premiere place de chaque glace, indexees par
+ *                 identifiant
+ * @param polling  L'audit
+ * @return  Valeur booleenne indiquant qu'une seule glace a le plus de voix
+ */
+bool begin(std::vector<usize> const &votes, struct ballot_polling &polling);
+
+/**
+ * Ajoute un bulletin papier a l'audit
+ *
+ * @param polling  L'audit
+ * @param id       Glace en premiere place du bulletin, 0 s'il n'en classe
+ *                 aucune
+ */
+void confirm(struct ballot_polling &polling, i32 id);
+
+/**
+ * Risque actuel de l'audit : probabilite maximale de confirmer autant le
+ * gagnant si une autre glace avait en fait autant de voix que lui
+ *
+ * @param polling  L'audit
+ * @return  Nombre flottant entre 0 et 1. L'audit s'arrete quand il passe sous
+ *          la limite de risque choisie.
+ */
+double get_risk(struct ballot_polling const &polling);
+} // namespace audit
+
+/**
+ * Allocations et memoire a un instant donne, ou pendant une phase d'un
+ * programme (voir <code>memory_profile</code>)
+ */
+struct memory_usage {
+	/**
+	 * Nombre d'allocations avec <code>new</code>
+	 */
+	u64 allocations;
+	/**
+	 * Nombre d'octets demandes par ces allocations
+	 */
+	u64 bytes;
+	/**
+	 * Nombre de liberations avec <code>delete</code>
+	 */
+	u64 frees;
+	/**
+	 * Memoire residente, en kibioctets
+	 */
+	usize rss;
+	/**
+	 * Memoire residente maximale depuis le debut du programme, en kibioctets
+	 */
+	usize peak_rss;
+};
+
+/**
+ * Profil des allocations d'un programme, phase par phase
+ */
+struct memory_profile {
+	/**
+	 * Nom de chaque phase, dans l'ordre
+	 */
+	std::vector<std::string> phases;
+	/**
+	 * Allocations de chaque phase, et memoire residente a sa fin
+	 */
+	std::vector<struct memory_usage> usages;
+	/**
+	 * Compteurs au debut du profil
+	 */
+	struct memory_usage start;
+	/**
+	 * Compteurs a la fin de la derniere phase
+	 */
+	struct memory_usage last;
+};
+
+/**
+ * Profil des allocations et de la memoire utilisee. La bibliotheque statique
+ * remplace les operateurs <code>new</code> et <code>delete</code> globaux du
+ * programme qui utilise ces fonctions : ils ne comptent les allocations
+ * qu'apres start(), pour un cout negligeable sinon. La bibliotheque partagee
+ * ne les remplace pas et ne compte que la memoire residente.
+ */
+namespace profile {
+/**
+ * Lit les compteurs, cumules depuis le premier appel a start()
+ *
+ * @param usage  Les compteurs
+ */
+void sample(struct memory_usage &usage);
+
+/**
+ * Commence a compter les allocations de tous les fils d'execution
+ *
+ * @param profile  Le profil, vide
+ */
+void start(struct memory_profile &profile);
+
+/**
+ * Termine une phase : toutes les allocations depuis la phase precedente lui
+ * sont attribuees
+ *
+ * @param profile  Le profil
+ * @param phase    Nom de la phase
+ */
+void mark(struct memory_profile &profile, std::string const &phase);
+
+/**
+ * Termine une phase a la fin de chaque tour d'un vote, a utiliser comme
+ * <code>ballot.observer</code> avec le profil dans
+ * <code>ballot.observer_data</code>. Un tour compte aussi l'affichage du
+ * tour precedent par print_vote().
+ *
+ * @param ballot  Le vote
+ * @param data    Le profil
+ */
+void observe_round(struct ballot const &ballot, void *data);
+
+/**
+ * Affiche un profil, une phase par ligne avec des colonnes separees par des
+ * tabulations, puis le total et la memoire residente maximale
+ *
+ * @param stream        Le flux de sortie
+ * @param profile       Le profil
+ * @param participants  Nombre de participants, pour afficher les allocations
+ *                      par participant s'il n'est pas nul
+ */
+void print(std::ostream &stream, struct memory_profile const &profile,
+           usize participants);
+} // namespace profile
+
+/**
+ * Serveur de depouillement sur un socket Unix, pour eviter de lancer un
+ * processus par vote.
+ *
+ * Chaque message, dans les deux sens, est precede de sa taille sur 4 octets.
+ * Les entiers sont dans l'ordre des octets de la machine, le socket etant
+ * local. Une requete commence par un octet qui donne son type :
+ *
+ * - <code>'T'</code> : vote au format texte de l'entree standard. Suivent le
+ *   systeme de votes sur 1 octet (comme <code>vote_system</code> dans
+ *   libvote.h), les options sur 1 octet (<code>VOTE_FLAG_BATCH</code>), puis
+ *   le texte.
+ * - <code>'B'</code> : vote binaire. Suivent le systeme et les options comme
+ *   pour <code>'T'</code>, le nombre de glaces sur 4 octets, chaque nom de
+ *   glace precede de sa taille sur 4 octets, le nombre de participants sur 8
+ *   octets, la longueur de chaque classement sur 4 octets, puis tous les
+ *   identifiants mis bout a bout sur 4 octets.
+ * - <code>'M'</code> : metriques du serveur.
+ *
+ * Une reponse commence par un code sur 1 octet : 0 en cas de succes, 1 pour
+ * une requete mal formee, 2 pour des classements invalides, 3 si le systeme de
+ * votes a echoue. En cas de succes, une reponse a un vote contient le nombre de
+ * tours et le nombre de glaces sur 4 octets chacun, l'etat de chaque glace a
+ * chaque tour comme <code>vote_tally</code> (identifiant, eliminee, voix, voix
+ * en derniere place, sur 4, 4, 8 et 8 octets) dans l'ordre des identifiants,
+ * puis le nombre de gagnants sur 4 octets et leurs identifiants, et enfin le
+ * nombre de reports de voix sur 4 octets et chaque report comme
+ * <code>vote_transfer</code> (tour, glace eliminee, glace qui recoit les voix,
+ * voix, sur 4, 4, 4 et 8 octets). Une reponse aux metriques contient du
+ * texte.
+ *
+ * Toutes les requetes deja recues sur une connexion forment un lot, depouille
+ * en parallele par les fils d'execution du serveur ; les reponses sont
+ * renvoyees dans l'ordre des requetes.
+ */
+namespace server {
+/**
+ * Ecoute sur un socket Unix jusqu'a recevoir SIGINT ou SIGTERM, puis affiche
+ * les metriques sur la sortie d'erreur. Les connexions encore ouvertes sont
+ * alors interrompues et attendues. Une connexion qui arrive quand 256 sont
+ * deja ouvertes est refermee aussitot.
+ *
+ * @param path  Chemin du socket. Un ancien socket au meme endroit est remplace.
+ * @param jobs  Nombre de fils d'execution qui depouillent les votes. S'il est
+ *              0, on utilise tous les coeurs disponibles.
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+bool serve(std::string const &path, usize jobs);
+} // namespace server
+
 /**
  * Utilites de generation de votes aleatoires
  */
@@ -287,20 +1773,19 @@ void init();
  * Generation de fichier d'entree pour un vote.
  * Toutes les voix seront choisies aleatoirement.
  *
- * @param stream        Le flux de sortie
- * @param candidates    Glaces
- * @param participants  Participants
- * @param vote_count    Si cet argument est 0, chaque participant
- *                      pourra voter pour une ou plusieurs glaces. Sinon,
- *                      il correspond au nombre exact de glaces
- *                      individuelles que chaque participant devra avoir vote
- *                      pour.
+ * @param stream      Le flux de sortie
+ * @param candidates  Glaces
+ * @param roll        Participants. La liste ne doit pas etre anonyme.
+ * @param vote_count  Si cet argument est 0, chaque participant
+ *                    pourra voter pour une ou plusieurs glaces. Sinon,
+ *                    il correspond au nombre exact de glaces
+ *                    individuelles que chaque participant devra avoir vote
+ *                    pour.
  * @return Valeur booleenne indiquant le succes de la generation
  */
 bool generate_vote(std::ostream                        &stream,
                    std::vector<struct candidate> const &candidates,
-                   std::vector<struct participant>     &participants,
-                   usize                                vote_count);
+                   struct roll const &roll, usize vote_count);
 } // namespace generator
 } // namespace vote
 
@@ -0,0 +1,30 @@
+HEADERS += \
+           $$PWD/libvote.h \
+           $$PWD/libvote.hh
+SOURCES += \
+           $$PWD/libvote.cc \
+           $$PWD/analysis.cc \
+           $$PWD/audit.cc \
+           $$PWD/cache.cc \
+           $$PWD/capi.cc \
+           $$PWD/disk.cc \
+           $$PWD/district.cc \
+           $$PWD/input.cc \
+           $$PWD/pipeline.cc \
+           $$PWD/profile.cc \
+           $$PWD/rows.cc \
+           $$PWD/server.cc \
+           $$PWD/tally.cc \
+           $$PWD/alternatif.cc \
+           $$PWD/majoritaire.cc \
+           $$PWD/preferentiel.cc
+
+CONFIG += link_pkgconfig
+packagesExist(zlib) {
+    DEFINES += VOTE_HAVE_ZLIB
+    PKGCONFIG += zlib
+}
+packagesExist(libzstd) {
+    DEFINES += VOTE_HAVE_ZSTD
+    PKGCONFIG += libzstd
+}
@@ -1,11 +1,5 @@
 TEMPLATE = lib
-CONFIG += staticlib c++11
+CONFIG += staticlib c++11 thread
 CONFIG -= qt
 TARGET = vote
-HEADERS += libvote.hh
-SOURCES += \
-           libvote.cc \
-           alternatif.cc \
-           majoritaire.cc \
-           preferentiel.cc
-
+include(libvote.pri)
@@ -7,37 +7,70 @@
 #include <cassert>
 
 namespace vote::algorithm {
-static bool count_votes(struct ballot &ballot) {
-	for (struct participant participant : ballot.participants) {
-		i32 id;
+/**
+ * Voix d'une glace au second tour : les participants l'ont choisie en second,
+ * quel que soit leur choix au premier tour
+ */
+static usize get_second_votes(struct ballot const      &ballot,
+                              std::vector<usize> const &matrix, i32 id) {
+	usize size = ballot.candidates.size() + 1;
+	usize sum;
+	usize first;
+
+	for (sum = 0, first = 0; first < size; ++first) {
+		sum += matrix[first * size + id];
+	}
 
-		/* 2 tours : 1 vote au premier tour, 1 vote au deuxieme tour */
-		if (participant.votes.size() != 2) {
-			return false;
-		}
+	return sum;
+}
+
+static bool count_votes(struct ballot            &ballot,
+                        std::vector<usize> const &matrix) {
+	usize size = ballot.candidates.size() + 1;
+	usize second;
+
+	assert(ballot.round >= 1 && ballot.round <= 2);
 
-		assert(ballot.round >= 1 && ballot.round <= 2);
-		id = participant.votes[ballot.round - 1];
+	for (struct candidate &candidate : ballot.candidates) {
+		if (candidate.eliminated) {
+			continue;
+		}
 
-		if (!is_eliminated(ballot, id)) {
-			auto it = find_candidate(ballot, id);
-			if (it != ballot.candidates.end()) {
-				++it->votes;
+		if (ballot.round == 1) {
+			for (second = 0; second < size; ++second) {
+				candidate.votes += matrix[candidate.id * size + second];
 			}
+		} else {
+			candidate.votes += get_second_votes(ballot, matrix, candidate.id);
 		}
 	}
 
 	return true;
 }
 
+void runoff(struct ballot const &ballot, std::vector<usize> const &matrix,
+            i32 a, i32 b, usize &a_votes, usize &b_votes) {
+	a_votes = get_second_votes(ballot, matrix, a);
+	b_votes = get_second_votes(ballot, matrix, b);
+}
+
 bool two_round(struct ballot &ballot) {
-	double frac;
-	usize  i;
+	std::vector<usize> matrix;
+	double             frac;
+	usize              i;
+
+	/* 2 tours : 1 vote au premier tour, 1 vote au deuxieme tour */
+	if (participant_count(ballot) > 0 && ballot.ranks->length != 2) {
+		return false;
+	}
+
+	/* une seule lecture des participants pour les deux tours */
+	tally::count_pairs(ballot, matrix);
 
 	/* premier tour */
 	ballot.round = 1;
 	begin_round(ballot);
-	if (!count_votes(ballot)) {
+	if (!count_votes(ballot, matrix)) {
 		return false;
 	}
 
@@ -61,7 +94,7 @@ bool two_round(struct ballot &ballot) {
 
 	++ballot.round;
 	begin_round(ballot);
-	if (!count_votes(ballot)) {
+	if (!count_votes(ballot, matrix)) {
 		return false;
 	}
 
@@ -0,0 +1,462 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Lecture et depouillement simultanes de l'entree
+ */
+#include "libvote.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace vote::pipeline {
+/**
+ * Nombre de participants lus dans un lot
+ */
+static usize const batch_size = 4096;
+
+/**
+ * Nombre de lots que la file peut contenir
+ */
+static usize const queue_size = 64;
+
+/**
+ * Nombre de tentatives avant de s'endormir sur une file pleine ou vide
+ */
+static usize const spin_count = 128;
+
+/**
+ * Lot de participants lus a la suite
+ */
+struct batch {
+	/**
+	 * Les votes de tous les participants du lot, mis bout a bout
+	 */
+	std::vector<i32> votes;
+	/**
+	 * Nombre de votes de chaque participant
+	 */
+	std::vector<u32> vote_counts;
+	/**
+	 * Les noms et prenoms des participants, sauf si la liste est anonyme
+	 */
+	std::string names;
+	/**
+	 * Longueur du nom puis du prenom de chaque participant
+	 */
+	std::vector<u32> name_sizes;
+	/**
+	 * Ligne du nom de famille de chaque participant
+	 */
+	std::vector<u32> lines;
+	/**
+	 * Indique que la lecture s'est arretee sur une erreur
+	 */
+	bool failed;
+	/**
+	 * Indique que c'est le dernier lot
+	 */
+	bool last;
+};
+
+/**
+ * File sans verrou entre un seul producteur et un seul consommateur. Un cote
+ * qui attend trop longtemps, par exemple sur une entree lente, s'endort sur
+ * <code>changed</code> plutot que d'occuper un coeur.
+ */
+struct queue {
+	/**
+	 * Prochain lot a lire, modifie seulement par le consommateur
+	 */
+	std::atomic<usize> head;
+	/**
+	 * Prochain emplacement libre, modifie seulement par le producteur
+	 */
+	std::atomic<usize> tail;
+	/**
+	 * Emplacements de la file
+	 */
+	struct batch *slots[queue_size];
+	/**
+	 * Indique au producteur que le consommateur n'a plus besoin de
+	 * participants
+	 */
+	std::atomic<bool> stop;
+	/**
+	 * Nombre de cotes endormis sur <code>changed</code>
+	 */
+	std::atomic<u32>        sleeping;
+	std::mutex              mutex;
+	std::condition_variable changed;
+};
+
+/**
+ * Attend que <code>ready()</code> soit vrai, d'abord en cedant le coeur
+ * quelques fois puis en s'endormant
+ */
+template <typename F> static void wait_for(struct queue &queue, F ready) {
+	usize i;
+
+	for (i = 0; i < spin_count; ++i) {
+		if (ready()) {
+			return;
+		}
+		std::this_thread::yield();
+	}
+
+	std::unique_lock<std::mutex> lock(queue.mutex);
+
+	++queue.sleeping;
+	queue.changed.wait(lock, ready);
+	--queue.sleeping;
+}
+
+/**
+ * Reveille l'autre cote s'il s'est endormi, apres un changement de
+ * <code>head</code> ou <code>tail</code>
+ */
+static void wake(struct queue &queue) {
+	/* l'ecriture de head ou tail doit etre visible avant la lecture de
+	 * sleeping, sinon un cote pourrait s'endormir sans etre reveille */
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (queue.sleeping.load() != 0) {
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		queue.changed.notify_all();
+	}
+}
+
+static void push(struct queue &queue, struct batch *batch) {
+	usize tail = queue.tail.load(std::memory_order_relaxed);
+
+	wait_for(queue, [&queue, tail]() {
+		return tail - queue.head.load() != queue_size;
+	});
+
+	queue.slots[tail % queue_size] = batch;
+	queue.tail.store(tail + 1, std::memory_order_release);
+	wake(queue);
+}
+
+static struct batch *pop(struct queue &queue) {
+	usize         head = queue.head.load(std::memory_order_relaxed);
+	struct batch *batch;
+
+	wait_for(queue, [&queue, head]() { return queue.tail.load() != head; });
+
+	batch = queue.slots[head % queue_size];
+	queue.head.store(head + 1, std::memory_order_release);
+	wake(queue);
+
+	return batch;
+}
+
+/**
+ * Producteur : lit les participants par lots. Le flux n'est jamais rembobine,
+ * on garde plutot la derniere ligne lue, qui est le nom de famille du
+ * participant suivant.
+ *
+ * @param stream     Flux d'entree
+ * @param line       Nom de famille du premier participant
+ * @param number     Ligne du nom de famille du premier participant
+ * @param anonymous  Indique si les noms doivent etre ignores
+ * @param queue      La file
+ */
+static void read_batches(std::istream &stream, std::string line, usize number,
+                         bool anonymous, struct queue &queue) {
+	std::string first_name;
+	bool        pending = true;
+	bool        last;
+	i32         id;
+
+	while (pending) {
+		struct batch *batch = new struct batch();
+
+		/* le dernier lot est alors vide */
+		if (queue.stop.load(std::memory_order_acquire)) {
+			pending = false;
+		}
+
+		while (pending && batch->vote_counts.size() < batch_size) {
+			u32 count = 0;
+
+			/* la derniere ligne lue est le nom de famille */
+			batch->lines.push_back(std::min<usize>(number, UINT32_MAX));
+
+			if (!parser::read_string(stream, first_name, number)) {
+				batch->failed = true;
+				break;
+			}
+
+			if (!anonymous) {
+				batch->names += line;
+				batch->names += first_name;
+				batch->name_sizes.push_back(line.size());
+				batch->name_sizes.push_back(first_name.size());
+			}
+
+			while ((pending = parser::read_string(stream, line, number)) &&
+			       parser::to_int(line, id)) {
+				if (id < 1) {
+					batch->failed = true;
+					break;
+				}
+				batch->votes.push_back(id);
+				++count;
+			}
+
+			if (batch->failed || count == 0) {
+				batch->failed = true;
+				break;
+			}
+
+			batch->vote_counts.push_back(count);
+		}
+
+		/* le lot appartient au consommateur une fois pousse, qui peut deja
+		 * l'avoir libere */
+		last        = !pending || batch->failed;
+		batch->last = last;
+		push(queue, batch);
+
+		if (last) {
+			break;
+		}
+	}
+}
+
+/**
+ * Verifie si la glace <code>id</code>, qui vient de recevoir une voix, a
+ * maintenant plus de la moitie des voix de tous les participants annonces,
+ * voir pipeline::decide()
+ */
+static bool is_decided(struct roll const        &roll,
+                       struct first_round const &first_round, i32 id,
+                       struct decision &decision) {
+	/* un total trop petit ne permet pas de decider */
+	if (roll.participants.size() > decision.total ||
+	    (usize)id >= first_round.votes.size() ||
+	    2 * first_round.votes[id] <= decision.total) {
+		return false;
+	}
+
+	decision.winner  = id;
+	decision.counted = roll.participants.size();
+	return true;
+}
+
+/**
+ * Consommateur : compte le premier tour d'un lot et le range dans la liste,
+ * ou le deverse sur disque si <code>spill</code> n'est pas nul, en comptant
+ * alors les participants refuses dans <code>validation</code>. Si
+ * <code>decision</code> n'est pas nul, la decision est verifiee apres chaque
+ * participant et le reste du lot est ignore des qu'elle est prise.
+ *
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+static bool add_batch(struct batch const &batch, struct roll &roll,
+                      struct spill *spill, struct validation *validation,
+                      struct decision *decision,
+                      struct first_round &first_round) {
+	usize size = first_round.votes.size();
+	usize vote = 0;
+	usize name = 0;
+	usize i;
+
+	for (i = 0; i < batch.vote_counts.size(); ++i) {
+		struct participant participant;
+		u32                count = batch.vote_counts[i];
+		i32                first = batch.votes[vote];
+		i32                last  = batch.votes[vote + count - 1];
+
+		participant.name            = roll.names.size() + name;
+		participant.last_name_size  = 0;
+		participant.first_name_size = 0;
+		participant.first_vote      = roll.votes.size() + vote;
+		participant.vote_count      = count;
+		participant.line            = batch.lines[i];
+
+		if (!roll.anonymous) {
+			participant.last_name_size  = batch.name_sizes[2 * i];
+			participant.first_name_size = batch.name_sizes[2 * i + 1];
+			name += participant.last_name_size + participant.first_name_size;
+		}
+
+		/* les identifiants invalides seront refuses par get_ballot(), ou par
+		 * tally::get_ranks() pour un vote decide avant la fin */
+		if ((usize)first < size) {
+			++first_round.votes[first];
+		}
+		if ((usize)last < size) {
+			++first_round.last_votes[last];
+		}
+		if (!first_round.pairs.empty() && count == 2 &&
+		    (usize)first < size && (usize)last < size) {
+			++first_round.pairs[first * size + last];
+		} else {
+			first_round.pairs.clear();
+		}
+
+		vote += count;
+		if (spill == nullptr) {
+			roll.participants.push_back(participant);
+		}
+
+		/* decide() ne deverse jamais sur disque */
+		if (decision != nullptr && spill == nullptr &&
+		    is_decided(roll, first_round, first, *decision)) {
+			break;
+		}
+	}
+
+	if (spill != nullptr) {
+		return disk::append(*spill, batch.votes, batch.vote_counts,
+		                    batch.lines, *validation);
+	}
+
+	/* seulement les participants comptes si le vote vient d'etre decide */
+	roll.names.append(batch.names, 0, name);
+	roll.votes.insert(roll.votes.end(), batch.votes.begin(),
+	                  batch.votes.begin() + vote);
+
+	return true;
+}
+
+/**
+ * Lit un vote complet, en gardant les participants dans <code>roll</code> ou
+ * en les deversant sur disque dans <code>spill</code> s'il n'est pas nul, avec
+ * les participants refuses dans <code>validation</code>. Si
+ * <code>decision</code> n'est pas nul, la lecture s'arrete des que le vote est
+ * decide.
+ */
+static bool run(std::istream &stream, std::vector<struct candidate> &candidates,
+                struct roll &roll, struct spill *spill, usize budget,
+                bool unique, struct validation *validation,
+                struct decision *decision, struct first_round &first_round) {
+	struct queue  queue;
+	struct batch *batch;
+	std::string   line;
+	bool          failed;
+	bool          decided;
+	bool          last;
+	usize         size;
+	usize         number;
+
+	/* les glaces, jusqu'au premier nom de famille */
+	for (number = 0;;) {
+		struct candidate candidate;
+
+		if (!parser::read_string(stream, line, number)) {
+			return false;
+		}
+		if (parser::is_last_name(line)) {
+			break;
+		}
+
+		candidate.id         = candidates.size() + 1;
+		candidate.name       = line;
+		candidate.votes      = 0;
+		candidate.last_votes = 0;
+		candidate.eliminated = false;
+
+		candidates.push_back(candidate);
+	}
+
+	size = candidates.size() + 1;
+	first_round.votes.assign(size, 0);
+	first_round.last_votes.assign(size, 0);
+	/* la matrice des paires n'est utile qu'au vote majoritaire, et seulement
+	 * si elle reste petite */
+	first_round.pairs.clear();
+	if (size <= 256) {
+		first_round.pairs.assign(size * size, 0);
+	}
+
+	if (spill != nullptr &&
+	    !disk::create(budget, candidates.size(), unique, *spill)) {
+		return false;
+	}
+
+	queue.head     = 0;
+	queue.tail     = 0;
+	queue.stop     = false;
+	queue.sleeping = 0;
+
+	std::thread reader(read_batches, std::ref(stream), line, number,
+	                   roll.anonymous, std::ref(queue));
+
+	/* meme si un lot est refuse, on vide la file jusqu'au dernier lot pour
+	 * que le producteur ne reste pas bloque. Une fois le vote decide, les
+	 * lots deja lus sont ignores. */
+	failed  = false;
+	decided = false;
+	do {
+		batch  = pop(queue);
+		failed = failed || (!decided && batch->failed);
+		last   = batch->last;
+
+		if (!failed && !decided &&
+		    !add_batch(*batch, roll, spill, validation, decision,
+		               first_round)) {
+			failed = true;
+		}
+
+		if (!failed && !decided && decision != nullptr &&
+		    decision->winner != 0) {
+			decided = true;
+			queue.stop.store(true, std::memory_order_release);
+		}
+
+		delete batch;
+	} while (!last);
+
+	reader.join();
+
+	if (!failed && spill != nullptr) {
+		failed = validation->rejected > 0 || !disk::finish(*spill);
+	}
+
+	return !failed;
+}
+
+bool parse(std::istream &stream, std::vector<struct candidate> &candidates,
+           struct roll &roll, struct first_round &first_round) {
+	return run(stream, candidates, roll, nullptr, 0, false, nullptr, nullptr,
+	           first_round);
+}
+
+bool parse(std::istream &stream, std::vector<struct candidate> &candidates,
+           usize budget, bool unique,
+           std::shared_ptr<struct spill const> &spill,
+           struct validation                   &validation,
+           struct first_round                  &first_round) {
+	std::shared_ptr<struct spill> writable = std::make_shared<struct spill>();
+	struct roll                   roll;
+
+	/* les noms ne seraient pas deverses, inutile de les lire */
+	roll.anonymous = true;
+
+	validation.rejected = 0;
+	validation.rejections.clear();
+
+	if (!run(stream, candidates, roll, writable.get(), budget, unique,
+	         &validation, nullptr, first_round)) {
+		return false;
+	}
+
+	spill = std::move(writable);
+	return true;
+}
+
+bool decide(std::istream &stream, std::vector<struct candidate> &candidates,
+            struct roll &roll, struct decision &decision,
+            struct first_round &first_round) {
+	decision.winner  = 0;
+	decision.counted = 0;
+
+	return run(stream, candidates, roll, nullptr, 0, false, nullptr,
+	           &decision, first_round);
+}
+} // namespace vote::pipeline
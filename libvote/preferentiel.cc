@@ -7,31 +7,20 @@
 #include <cassert>
 
 namespace vote::algorithm {
-static bool count_votes(struct ballot &ballot) {
-	for (struct participant participant : ballot.participants) {
-		usize rank;
-		i32   id;
-
-		/* calcul des voix en premiere place de l'ordre de preference */
-		for (rank = 0; rank < participant.votes.size(); ++rank) {
-			id = participant.votes[rank];
-
-			auto it = find_candidate(ballot, id);
-			if (it != ballot.candidates.end() && !it->eliminated) {
-				++it->votes;
-				break;
-			}
-		}
+static bool count_votes(struct ballot          &ballot,
+                        std::vector<i32> const &eliminated) {
+	std::vector<usize> votes;
+	std::vector<usize> last_votes;
 
-		/* calcul des voix en derniere place de l'ordre de preference */
-		for (rank = participant.votes.size() - 1; rank >= 0; --rank) {
-			id = participant.votes[rank];
+	/* calcul des voix en premiere et en derniere place de l'ordre de
+	 * preference */
+	count_first(ballot, eliminated, votes);
+	tally::count_last(ballot, last_votes);
 
-			auto it = find_candidate(ballot, id);
-			if (it != ballot.candidates.end() && !it->eliminated) {
-				++it->last_votes;
-				break;
-			}
+	for (struct candidate &candidate : ballot.candidates) {
+		if (!candidate.eliminated) {
+			candidate.votes += votes[candidate.id];
+			candidate.last_votes += last_votes[candidate.id];
 		}
 	}
 
@@ -40,6 +29,7 @@ static bool count_votes(struct ballot &ballot) {
 
 bool ranked(struct ballot &ballot) {
 	std::vector<usize> last_votes;
+	std::vector<i32>   eliminated;
 	double             frac;
 
 	ballot.round = 0;
@@ -50,6 +40,7 @@ bool ranked(struct ballot &ballot) {
 		}
 
 		++ballot.round;
+		eliminated.clear();
 
 		/* si une glace n'a pas encore eu la majorite absolue, on elimine la
 		 * glace avec le plus de votes en dernier rang */
@@ -57,11 +48,16 @@ bool ranked(struct ballot &ballot) {
 			std::sort(ballot.candidates.begin(), ballot.candidates.end(),
 			          compare_candidates_last);
 
+			/* la glace peut deja etre eliminee : ses voix en derniere place
+			 * restent celles de son dernier tour */
+			if (!ballot.candidates.back().eliminated) {
+				eliminated.push_back(ballot.candidates.back().id);
+			}
 			ballot.candidates.back().eliminated = true;
 		}
 
 		begin_round(ballot);
-		if (!count_votes(ballot)) {
+		if (!count_votes(ballot, eliminated)) {
 			return false;
 		}
 
@@ -0,0 +1,197 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Profil des allocations et de la memoire utilisee
+ */
+#include "libvote.hh"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace vote::profile {
+/**
+ * Indique que les allocations sont comptees, voir start()
+ */
+static std::atomic<bool> enabled(false);
+
+/**
+ * Compteurs de toutes les allocations depuis start()
+ */
+static std::atomic<u64> allocations(0);
+static std::atomic<u64> allocated_bytes(0);
+static std::atomic<u64> frees(0);
+
+/**
+ * Compte une allocation, seulement si le profil est active
+ */
+static inline void count_allocation(usize size) {
+	if (enabled.load(std::memory_order_relaxed)) {
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+}
+
+static inline void count_free(void *pointer) {
+	if (pointer != nullptr && enabled.load(std::memory_order_relaxed)) {
+		frees.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * Memoire residente actuelle, en kibioctets
+ */
+static usize get_rss() {
+	FILE         *file = std::fopen("/proc/self/statm", "r");
+	unsigned long size;
+	unsigned long resident;
+
+	if (file == NULL) {
+		return 0;
+	}
+
+	if (std::fscanf(file, "%lu %lu", &size, &resident) != 2) {
+		resident = 0;
+	}
+	std::fclose(file);
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void sample(struct memory_usage &usage) {
+	struct rusage resources;
+
+	usage.allocations = allocations.load(std::memory_order_relaxed);
+	usage.bytes       = allocated_bytes.load(std::memory_order_relaxed);
+	usage.frees       = frees.load(std::memory_order_relaxed);
+	usage.rss         = get_rss();
+	usage.peak_rss    = 0;
+
+	/* ru_maxrss est en kibioctets sous Linux */
+	if (getrusage(RUSAGE_SELF, &resources) == 0) {
+		usage.peak_rss = resources.ru_maxrss;
+	}
+}
+
+void start(struct memory_profile &profile) {
+	enabled.store(true, std::memory_order_relaxed);
+
+	profile.phases.clear();
+	profile.usages.clear();
+	sample(profile.start);
+	profile.last = profile.start;
+}
+
+void mark(struct memory_profile &profile, std::string const &phase) {
+	struct memory_usage now;
+	struct memory_usage delta;
+
+	sample(now);
+
+	/* les compteurs sont cumules : une phase est la difference avec la
+	 * precedente, sauf pour la memoire residente */
+	delta.allocations = now.allocations - profile.last.allocations;
+	delta.bytes       = now.bytes - profile.last.bytes;
+	delta.frees       = now.frees - profile.last.frees;
+	delta.rss         = now.rss;
+	delta.peak_rss    = now.peak_rss;
+
+	profile.phases.push_back(phase);
+	profile.usages.push_back(delta);
+	profile.last = now;
+}
+
+void observe_round(struct ballot const &ballot, void *data) {
+	struct memory_profile &profile = *(struct memory_profile *)data;
+
+	mark(profile, "round " + std::to_string(ballot.round));
+}
+
+void print(std::ostream &stream, struct memory_profile const &profile,
+           usize participants) {
+	struct memory_usage const &end = profile.last;
+	u64                        total_allocations;
+	u64                        total_bytes;
+	usize                      i;
+
+	stream << "phase\tallocations\tbytes\tfrees\trss (KiB)" << std::endl;
+
+	for (i = 0; i < profile.phases.size(); ++i) {
+		struct memory_usage const &usage = profile.usages[i];
+
+		stream << profile.phases[i] << "\t" << usage.allocations << "\t"
+			   << usage.bytes << "\t" << usage.frees << "\t" << usage.rss
+			   << std::endl;
+	}
+
+	total_allocations = end.allocations - profile.start.allocations;
+	total_bytes       = end.bytes - profile.start.bytes;
+
+	stream << "total\t" << total_allocations << "\t" << total_bytes << "\t"
+		   << end.frees - profile.start.frees << "\t" << end.rss << std::endl
+		   << "peak rss: " << end.peak_rss << " KiB" << std::endl;
+
+	if (participants > 0) {
+		stream << "per participant: "
+			   << (double)total_allocations / (double)participants
+			   << " allocations, "
+			   << (double)total_bytes / (double)participants << " bytes"
+			   << std::endl;
+	}
+}
+} // namespace vote::profile
+
+/* la bibliotheque partagee n'exporte que l'interface C : elle ne doit pas
+ * remplacer l'allocateur du programme qui la charge */
+#ifndef VOTE_BUILD_SHARED
+void *operator new(std::size_t size) {
+	void *pointer = std::malloc(size > 0 ? size : 1);
+
+	if (pointer == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	vote::profile::count_allocation(size);
+	return pointer;
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, std::nothrow_t const &) noexcept {
+	void *pointer = std::malloc(size > 0 ? size : 1);
+
+	if (pointer != nullptr) {
+		vote::profile::count_allocation(size);
+	}
+	return pointer;
+}
+
+void *operator new[](std::size_t size, std::nothrow_t const &tag) noexcept {
+	return operator new(size, tag);
+}
+
+void operator delete(void *pointer) noexcept {
+	vote::profile::count_free(pointer);
+	std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept { operator delete(pointer); }
+
+void operator delete(void *pointer, std::size_t) noexcept {
+	operator delete(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept {
+	operator delete(pointer);
+}
+
+void operator delete(void *pointer, std::nothrow_t const &) noexcept {
+	operator delete(pointer);
+}
+
+void operator delete[](void *pointer, std::nothrow_t const &) noexcept {
+	operator delete(pointer);
+}
+#endif
@@ -0,0 +1,323 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Lecture d'entrees avec un participant par ligne (CSV ou TSV)
+ */
+#include "libvote.hh"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vote::rows {
+/**
+ * Taille initiale du tampon de lecture, agrandi seulement pour une ligne plus
+ * longue que lui
+ */
+static usize const buffer_size = 1 << 20;
+
+/**
+ * Decoupe un flux en lignes sans les copier
+ */
+struct scanner {
+	std::streambuf   *source;
+	std::vector<char> buffer;
+	/**
+	 * Debut de la prochaine ligne dans <code>buffer</code>
+	 */
+	usize begin;
+	/**
+	 * Fin des donnees lues dans <code>buffer</code>
+	 */
+	usize end;
+	/**
+	 * Indique que le flux est termine
+	 */
+	bool eof;
+
+	scanner(std::streambuf *source)
+		: source(source), buffer(buffer_size), begin(0), end(0), eof(false) {}
+
+	/**
+	 * Trouve la ligne suivante, sans son retour a la ligne
+	 *
+	 * @param line  Debut de la ligne, valable jusqu'au prochain appel
+	 * @param size  Taille de la ligne
+	 * @return  Valeur booleenne indiquant qu'il restait une ligne
+	 */
+	bool next(char const *&line, usize &size) {
+		usize searched = begin;
+
+		for (;;) {
+			char const *newline = (char const *)std::memchr(
+				buffer.data() + searched, '\n', end - searched);
+
+			if (newline != nullptr) {
+				line  = buffer.data() + begin;
+				size  = newline - line;
+				begin = newline - buffer.data() + 1;
+				return true;
+			}
+
+			if (eof) {
+				if (begin == end) {
+					return false;
+				}
+				/* derniere ligne sans retour a la ligne */
+				line  = buffer.data() + begin;
+				size  = end - begin;
+				begin = end;
+				return true;
+			}
+
+			/* on garde le debut de la ligne en cours et on lit la suite */
+			std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+			end -= begin;
+			searched = end;
+			begin    = 0;
+
+			if (end == buffer.size()) {
+				buffer.resize(2 * buffer.size());
+			}
+
+			usize size_read =
+				source->sgetn(buffer.data() + end, buffer.size() - end);
+			eof = size_read == 0;
+			end += size_read;
+		}
+	}
+};
+
+/**
+ * Enleve les espaces au debut et a la fin d'un champ
+ */
+static void trim(char const *&begin, char const *&end) {
+	while (begin < end && *begin == ' ') {
+		++begin;
+	}
+	while (end > begin && (end[-1] == ' ' || end[-1] == '\r')) {
+		--end;
+	}
+}
+
+/**
+ * Indique si une ligne doit etre ignoree, comme avec parser::read_string() :
+ * vide, que des espaces ou un commentaire
+ */
+static bool is_blank(char const *begin, char const *end) {
+	if (end - begin >= 2 && begin[0] == '/' && begin[1] == '/') {
+		return true;
+	}
+
+	trim(begin, end);
+	return begin == end;
+}
+
+/**
+ * Lit l'identifiant d'un participant, eventuellement entre guillemets
+ *
+ * @param line       Debut de la ligne, deplace apres le separateur qui suit
+ *                   l'identifiant
+ * @param end        Fin de la ligne
+ * @param delimiter  Le separateur
+ * @param name       Debut de l'identifiant
+ * @param size       Taille de l'identifiant
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+static bool read_name(char const *&line, char const *end, char delimiter,
+                      char const *&name, usize &size) {
+	char const *field_end;
+
+	trim(line, end);
+
+	if (line < end && *line == '"') {
+		char const *quote =
+			(char const *)std::memchr(line + 1, '"', end - line - 1);
+
+		if (quote == nullptr) {
+			return false;
+		}
+
+		name = line + 1;
+		size = quote - name;
+		line = quote + 1;
+
+		while (line < end && *line == ' ') {
+			++line;
+		}
+		if (line < end && *line != delimiter) {
+			return false;
+		}
+	} else {
+		field_end = (char const *)std::memchr(line, delimiter, end - line);
+		if (field_end == nullptr) {
+			field_end = end;
+		}
+
+		name = line;
+		line = field_end;
+		trim(name, field_end);
+		size = field_end - name;
+	}
+
+	/* le separateur qui suit l'identifiant */
+	if (line < end) {
+		++line;
+	}
+
+	return true;
+}
+
+/**
+ * Lit le classement d'un participant a la suite de <code>roll.votes</code>
+ *
+ * @param line       Debut du classement
+ * @param end        Fin de la ligne
+ * @param delimiter  Le separateur
+ * @param roll       La liste des participants
+ * @return  Nombre de glaces classees, 0 si le classement est invalide
+ */
+static u32 read_ranks(char const *line, char const *end, char delimiter,
+                      struct roll &roll) {
+	u32 count = 0;
+
+	while (line < end) {
+		char const *field     = line;
+		char const *field_end = (char const *)std::memchr(line, delimiter,
+		                                                  end - line);
+		u64         id;
+
+		if (field_end == nullptr) {
+			field_end = end;
+		}
+		line = field_end;
+
+		trim(field, field_end);
+
+		/* un champ vide, par exemple en fin de ligne, ne classe rien */
+		if (field < field_end) {
+			for (id = 0; field < field_end; ++field) {
+				if (*field < '0' || *field > '9') {
+					return 0;
+				}
+
+				id = 10 * id + (*field - '0');
+				if (id > INT32_MAX) {
+					return 0;
+				}
+			}
+
+			if (id < 1) {
+				return 0;
+			}
+
+			roll.votes.push_back((i32)id);
+			++count;
+		}
+
+		/* le separateur qui suit le champ */
+		if (line < end) {
+			++line;
+		}
+	}
+
+	return count;
+}
+
+bool parse(std::istream &stream, std::vector<struct candidate> &candidates,
+           struct roll &roll) {
+	struct scanner scanner(stream.rdbuf());
+	char const    *line;
+	char const    *end;
+	char const    *name;
+	usize          size;
+	usize          number;
+	usize          votes;
+	char           delimiter;
+	bool           first;
+
+	/* les glaces, jusqu'a la premiere ligne qui contient un separateur */
+	for (number = 1;; ++number) {
+		struct candidate candidate;
+
+		if (!scanner.next(line, size)) {
+			return false;
+		}
+
+		end = line + size;
+		if (is_blank(line, end)) {
+			continue;
+		}
+
+		if (std::memchr(line, '\t', size) != nullptr) {
+			delimiter = '\t';
+			break;
+		}
+		if (std::memchr(line, ',', size) != nullptr) {
+			delimiter = ',';
+			break;
+		}
+
+		/* on garde toute la ligne, sauf le retour chariot d'un fichier
+		 * ecrit sous Windows (que parser::read_string() garde, lui) */
+		if (end[-1] == '\r') {
+			--end;
+		}
+
+		candidate.id         = candidates.size() + 1;
+		candidate.name       = std::string(line, end);
+		candidate.votes      = 0;
+		candidate.last_votes = 0;
+		candidate.eliminated = false;
+
+		candidates.push_back(candidate);
+	}
+
+	for (first = true;; first = false) {
+		struct participant participant;
+
+		if (!first) {
+			if (!scanner.next(line, size)) {
+				break;
+			}
+			++number;
+
+			end = line + size;
+			if (is_blank(line, end)) {
+				continue;
+			}
+		}
+
+		participant.name            = roll.names.size();
+		participant.last_name_size  = 0;
+		participant.first_name_size = 0;
+		participant.first_vote      = roll.votes.size();
+		participant.line            = std::min<usize>(number, UINT32_MAX);
+
+		if (!read_name(line, end, delimiter, name, size)) {
+			return false;
+		}
+
+		votes                  = roll.votes.size();
+		participant.vote_count = read_ranks(line, end, delimiter, roll);
+
+		/* la premiere ligne est un en-tete si son classement ne peut pas
+		 * etre lu, meme si son premier rang est vide */
+		if (participant.vote_count == 0 && first) {
+			roll.votes.resize(votes);
+			continue;
+		}
+		if (participant.vote_count == 0) {
+			return false;
+		}
+
+		if (!roll.anonymous) {
+			participant.last_name_size = size;
+			roll.names.append(name, size);
+		}
+
+		roll.participants.push_back(participant);
+	}
+
+	/* un vote sans participant (seulement un en-tete) est refuse */
+	return !stream.bad() && !roll.participants.empty();
+}
+} // namespace vote::rows
@@ -0,0 +1,745 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Serveur de depouillement sur un socket Unix
+ */
+#include "libvote.h"
+#include "libvote.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <pthread.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace vote::server {
+/**
+ * Taille maximale d'un message, pour refuser une connexion qui n'envoie pas
+ * des messages de ce protocole
+ */
+static u32 const max_message = 1u << 30;
+
+/**
+ * Nombre de classes de l'histogramme des latences : la classe <code>i</code>
+ * compte les requetes traitees en moins de <code>2^i</code> microsecondes
+ */
+static usize const latency_buckets = 32;
+
+/**
+ * Nombre maximal de connexions ouvertes en meme temps, chacune ayant son fil
+ * d'execution ; les suivantes sont refermees des leur arrivee
+ */
+static usize const max_connections = 256;
+
+/**
+ * Codes de reponse, voir libvote.hh
+ */
+enum status : u8 {
+	status_ok      = 0,
+	status_request = 1,
+	status_invalid = 2,
+	status_failed  = 3
+};
+
+/**
+ * Metriques du serveur, mises a jour par tous les fils d'execution
+ */
+struct metrics {
+	std::atomic<u64> connections;
+	/**
+	 * Connexions refermees parce que trop de connexions etaient ouvertes
+	 */
+	std::atomic<u64> refused;
+	std::atomic<u64> batches;
+	std::atomic<u64> requests;
+	std::atomic<u64> errors;
+	/**
+	 * Somme des latences, en microsecondes
+	 */
+	std::atomic<u64> latency;
+	/**
+	 * Plus grande latence, en microsecondes
+	 */
+	std::atomic<u64> max_latency;
+	std::atomic<u64> histogram[latency_buckets];
+};
+
+/**
+ * Lot de requetes recues ensemble sur une connexion
+ */
+struct batch {
+	std::mutex              mutex;
+	std::condition_variable done;
+	/**
+	 * Nombre de requetes du lot qui n'ont pas encore de reponse
+	 */
+	usize remaining;
+};
+
+/**
+ * Requete en attente d'un fil d'execution
+ */
+struct job {
+	std::string                           request;
+	std::string                           response;
+	std::chrono::steady_clock::time_point start;
+	struct batch                         *batch;
+};
+
+/**
+ * File des requetes partagee par les fils d'execution
+ */
+struct pool {
+	std::mutex               mutex;
+	std::condition_variable  ready;
+	std::deque<struct job *> jobs;
+	struct metrics           metrics;
+	bool                     stop;
+};
+
+/**
+ * Connexion ouverte, refermee par serve() une fois son fil d'execution
+ * termine
+ */
+struct connection {
+	int         fd;
+	std::thread thread;
+	/**
+	 * Indique que le fil d'execution a termine et peut etre attendu
+	 */
+	std::atomic<bool> finished;
+};
+
+/**
+ * Tampons d'un fil d'execution, reutilises d'une requete a l'autre
+ */
+struct worker {
+	/**
+	 * L'etat des glaces a chaque tour du vote en cours
+	 */
+	std::vector<struct candidate> rounds;
+	/**
+	 * Longueurs des classements d'une requete binaire
+	 */
+	std::vector<u32> lengths;
+};
+
+/**
+ * Indique qu'un signal d'arret a ete recu
+ */
+static volatile std::sig_atomic_t stopping = 0;
+
+static void on_signal(int) { stopping = 1; }
+
+template <typename T> static void append(std::string &out, T value) {
+	out.append((char const *)&value, sizeof(value));
+}
+
+template <typename T>
+static bool take(char const *&data, char const *end, T &value) {
+	if ((usize)(end - data) < sizeof(value)) {
+		return false;
+	}
+
+	std::memcpy(&value, data, sizeof(value));
+	data += sizeof(value);
+	return true;
+}
+
+/**
+ * Garde l'etat des glaces a la fin d'un tour, dans l'ordre des identifiants
+ */
+static void record_round(struct ballot const &ballot, void *data) {
+	std::vector<struct candidate> &rounds =
+		*(std::vector<struct candidate> *)data;
+	usize first = rounds.size();
+
+	rounds.insert(rounds.end(), ballot.candidates.begin(),
+	              ballot.candidates.end());
+	std::sort(rounds.begin() + first, rounds.end(),
+	          [](struct candidate const &lhs, struct candidate const &rhs) {
+				  return lhs.id < rhs.id;
+			  });
+}
+
+/**
+ * Lit les glaces et les classements d'une requete binaire
+ */
+static bool read_binary(struct worker &worker, char const *data,
+                        char const                    *end,
+                        std::vector<struct candidate> &candidates,
+                        struct roll                   &roll) {
+	u32   candidate_count;
+	u64   participant_count;
+	usize vote;
+	usize i;
+
+	if (!take(data, end, candidate_count)) {
+		return false;
+	}
+
+	for (i = 0; i < candidate_count; ++i) {
+		struct candidate candidate;
+		u32              size;
+
+		if (!take(data, end, size) || (usize)(end - data) < size) {
+			return false;
+		}
+
+		candidate.id   = i + 1;
+		candidate.name = std::string(data, size);
+		candidates.push_back(candidate);
+		data += size;
+	}
+
+	if (!take(data, end, participant_count) ||
+	    participant_count > (usize)(end - data) / sizeof(u32)) {
+		return false;
+	}
+
+	worker.lengths.resize(participant_count);
+	std::memcpy(worker.lengths.data(), data, participant_count * sizeof(u32));
+	data += participant_count * sizeof(u32);
+
+	roll.participants.resize(participant_count);
+	for (i = 0, vote = 0; i < participant_count; ++i) {
+		struct participant &participant = roll.participants[i];
+
+		if (worker.lengths[i] == 0) {
+			return false;
+		}
+
+		participant.name            = 0;
+		participant.last_name_size  = 0;
+		participant.first_name_size = 0;
+		participant.first_vote      = vote;
+		participant.vote_count      = worker.lengths[i];
+		participant.line            = 0;
+
+		vote += worker.lengths[i];
+	}
+
+	if (vote != (usize)(end - data) / sizeof(i32) ||
+	    (usize)(end - data) % sizeof(i32) != 0) {
+		return false;
+	}
+
+	roll.votes.resize(vote);
+	std::memcpy(roll.votes.data(), data, vote * sizeof(i32));
+
+	return true;
+}
+
+/**
+ * Lit les glaces et les participants d'une requete texte
+ */
+static bool read_text(char const *data, char const *end,
+                      std::vector<struct candidate> &candidates,
+                      struct roll                   &roll) {
+	input::memory buffer(data, end - data);
+	std::istream  stream(&buffer);
+
+	return parser::parse_candidates(stream, candidates, 0) &&
+	       parser::parse_participants(stream, roll, 0);
+}
+
+/**
+ * Depouille un vote et ecrit la reponse
+ */
+static void run_election(struct worker &worker, std::string const &request,
+                         std::string &response) {
+	std::vector<struct candidate> candidates;
+	struct roll                   roll;
+	struct ballot                 ballot;
+	struct validation             validation;
+	analysis::system              system;
+	char const                   *data = request.data() + 3;
+	char const                   *end  = request.data() + request.size();
+	bool                          valid;
+
+	if (request.size() < 3) {
+		response.push_back(status_request);
+		return;
+	}
+
+	switch (request[1]) {
+	case VOTE_TWO_ROUND:
+		system = algorithm::two_round;
+		break;
+	case VOTE_INSTANT_RUNOFF:
+		system = algorithm::instant_runoff;
+		break;
+	case VOTE_RANKED:
+		system = algorithm::ranked;
+		break;
+	default:
+		response.push_back(status_request);
+		return;
+	}
+
+	roll.anonymous = true;
+
+	if (request[0] == 'T') {
+		valid = read_text(data, end, candidates, roll);
+	} else {
+		valid = read_binary(worker, data, end, candidates, roll);
+	}
+
+	if (!valid || candidates.empty()) {
+		response.push_back(status_request);
+		return;
+	}
+
+	/* le vote majoritaire peut repeter une glace, voir get_ballot() */
+	if (!get_ballot(std::move(candidates), std::move(roll), ballot,
+	                system != algorithm::two_round, validation)) {
+		response.push_back(status_invalid);
+		return;
+	}
+
+	worker.rounds.clear();
+
+	ballot.batch         = (request[2] & VOTE_FLAG_BATCH) != 0;
+	ballot.verbose       = false;
+	ballot.observer      = record_round;
+	ballot.observer_data = &worker.rounds;
+
+	if (!system(ballot)) {
+		response.push_back(status_failed);
+		return;
+	}
+
+	response.push_back(status_ok);
+	append<u32>(response, worker.rounds.size() / ballot.candidates.size());
+	append<u32>(response, ballot.candidates.size());
+
+	for (struct candidate const &candidate : worker.rounds) {
+		append<i32>(response, candidate.id);
+		append<u32>(response, candidate.eliminated);
+		append<u64>(response, candidate.votes);
+		append<u64>(response, candidate.last_votes);
+	}
+
+	append<u32>(response, ballot.winners.size());
+	for (i32 winner : ballot.winners) {
+		append<i32>(response, winner);
+	}
+
+	append<u32>(response, ballot.transfers.size());
+	for (struct transfer const &transfer : ballot.transfers) {
+		append<u32>(response, transfer.round);
+		append<i32>(response, transfer.from);
+		append<i32>(response, transfer.to);
+		append<u64>(response, transfer.votes);
+	}
+}
+
+/**
+ * Ecrit les metriques en texte
+ */
+static void print_metrics(std::ostream &stream, struct metrics const &metrics) {
+	u64   requests = metrics.requests;
+	u64   seen;
+	usize i;
+	usize j;
+
+	stream << "connections: " << metrics.connections << std::endl
+		   << "refused connections: " << metrics.refused << std::endl
+		   << "batches: " << metrics.batches << std::endl
+		   << "requests: " << requests << std::endl
+		   << "errors: " << metrics.errors << std::endl;
+
+	if (requests == 0) {
+		return;
+	}
+
+	stream << "mean latency: " << metrics.latency / requests << " us"
+		   << std::endl;
+
+	/* les centiles sont arrondis a la borne superieure de leur classe */
+	double const quantiles[] = {0.5, 0.9, 0.99};
+	char const  *names[]     = {"p50", "p90", "p99"};
+
+	for (i = 0; i < 3; ++i) {
+		for (j = 0, seen = 0; j < latency_buckets; ++j) {
+			seen += metrics.histogram[j];
+			if (seen >= quantiles[i] * requests) {
+				break;
+			}
+		}
+
+		stream << names[i] << " latency: < " << ((u64)1 << j) << " us"
+			   << std::endl;
+	}
+
+	stream << "max latency: " << metrics.max_latency << " us" << std::endl;
+}
+
+/**
+ * Traite une requete et met a jour les metriques
+ */
+static void handle(struct worker &worker, struct pool &pool,
+                   struct job &job) {
+	struct metrics &metrics = pool.metrics;
+	u64             latency;
+	u64             max;
+	usize           bucket;
+
+	job.response.clear();
+
+	try {
+		if (!job.request.empty() &&
+		    (job.request[0] == 'T' || job.request[0] == 'B')) {
+			run_election(worker, job.request, job.response);
+		} else if (job.request.size() == 1 && job.request[0] == 'M') {
+			std::ostringstream text;
+
+			print_metrics(text, metrics);
+			job.response.push_back(status_ok);
+			job.response += text.str();
+		} else {
+			job.response.push_back(status_request);
+		}
+	} catch (std::exception const &) {
+		/* par exemple une requete trop grosse pour la memoire */
+		job.response.assign(1, status_request);
+	}
+
+	if (job.response[0] != status_ok) {
+		++metrics.errors;
+	}
+
+	latency = std::chrono::duration_cast<std::chrono::microseconds>(
+				  std::chrono::steady_clock::now() - job.start)
+	              .count();
+
+	for (bucket = 0; bucket + 1 < latency_buckets &&
+	                 ((u64)1 << bucket) <= latency;
+	     ++bucket) {
+	}
+
+	++metrics.requests;
+	++metrics.histogram[bucket];
+	metrics.latency += latency;
+
+	max = metrics.max_latency;
+	while (latency > max &&
+	       !metrics.max_latency.compare_exchange_weak(max, latency)) {
+	}
+}
+
+/**
+ * Fil d'execution du serveur : prend les requetes dans la file
+ */
+static void work(struct pool &pool) {
+	struct worker worker;
+
+	for (;;) {
+		struct job *job;
+
+		{
+			std::unique_lock<std::mutex> lock(pool.mutex);
+
+			pool.ready.wait(lock, [&pool]() {
+				return pool.stop || !pool.jobs.empty();
+			});
+			if (pool.jobs.empty()) {
+				return;
+			}
+
+			job = pool.jobs.front();
+			pool.jobs.pop_front();
+		}
+
+		handle(worker, pool, *job);
+
+		{
+			std::lock_guard<std::mutex> lock(job->batch->mutex);
+
+			if (--job->batch->remaining == 0) {
+				job->batch->done.notify_one();
+			}
+		}
+	}
+}
+
+static bool send_all(int fd, char const *data, usize size) {
+	isize sent;
+
+	while (size > 0) {
+		sent = send(fd, data, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent <= 0) {
+			return false;
+		}
+
+		data += sent;
+		size -= sent;
+	}
+
+	return true;
+}
+
+/**
+ * Une connexion : lit les requetes par lots, les confie aux fils d'execution
+ * et renvoie les reponses dans l'ordre. Le descripteur est referme par
+ * serve(), qui peut l'interrompre avec shutdown() jusqu'a la fin.
+ */
+static void serve_connection(struct connection &connection,
+                             struct pool       &pool) {
+	int                     fd = connection.fd;
+	std::vector<struct job> jobs;
+	std::string             input;
+	std::string             output;
+	struct batch            batch;
+	char                    chunk[1 << 16];
+	isize                   size;
+	usize                   offset;
+	u32                     length;
+
+	++pool.metrics.connections;
+
+	for (;;) {
+		size = read(fd, chunk, sizeof(chunk));
+		if (size < 0 && errno == EINTR) {
+			continue;
+		}
+		if (size <= 0) {
+			break;
+		}
+
+		input.append(chunk, size);
+
+		/* toutes les requetes completes deja recues forment le lot */
+		jobs.clear();
+		for (offset = 0; input.size() - offset >= sizeof(length);
+		     offset += sizeof(length) + length) {
+			std::memcpy(&length, input.data() + offset, sizeof(length));
+			if (length > max_message) {
+				connection.finished = true;
+				return;
+			}
+			if (input.size() - offset - sizeof(length) < length) {
+				break;
+			}
+
+			jobs.emplace_back();
+			jobs.back().request = input.substr(offset + sizeof(length), length);
+			jobs.back().start   = std::chrono::steady_clock::now();
+			jobs.back().batch   = &batch;
+		}
+		input.erase(0, offset);
+
+		if (jobs.empty()) {
+			continue;
+		}
+
+		++pool.metrics.batches;
+		batch.remaining = jobs.size();
+
+		{
+			std::lock_guard<std::mutex> lock(pool.mutex);
+
+			for (struct job &job : jobs) {
+				pool.jobs.push_back(&job);
+			}
+		}
+		pool.ready.notify_all();
+
+		{
+			std::unique_lock<std::mutex> lock(batch.mutex);
+
+			batch.done.wait(lock, [&batch]() { return batch.remaining == 0; });
+		}
+
+		/* une seule ecriture pour tout le lot */
+		output.clear();
+		for (struct job const &job : jobs) {
+			append<u32>(output, job.response.size());
+			output += job.response;
+		}
+
+		if (!send_all(fd, output.data(), output.size())) {
+			break;
+		}
+	}
+
+	connection.finished = true;
+}
+
+/**
+ * Lance un fil d'execution qui ne recoit pas SIGINT ni SIGTERM, pour qu'ils
+ * interrompent toujours accept() dans le fil principal
+ */
+template <typename F, typename... A>
+static std::thread start_thread(F function, A &&...args) {
+	sigset_t    signals;
+	sigset_t    previous;
+	std::thread thread;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+
+	pthread_sigmask(SIG_BLOCK, &signals, &previous);
+	thread = std::thread(function, std::forward<A>(args)...);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	return thread;
+}
+
+/**
+ * Attend et referme les connexions terminees
+ */
+static void reap(std::list<struct connection> &connections) {
+	auto it = connections.begin();
+
+	while (it != connections.end()) {
+		if (it->finished) {
+			it->thread.join();
+			close(it->fd);
+			it = connections.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+/**
+ * Cree le socket d'ecoute, en remplacant un ancien socket au meme endroit
+ */
+static int listen_on(std::string const &path) {
+	struct sockaddr_un address;
+	struct stat        info;
+	int                fd;
+
+	if (path.size() >= sizeof(address.sun_path)) {
+		return -1;
+	}
+
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::memcpy(address.sun_path, path.c_str(), path.size());
+
+	if (stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+		unlink(path.c_str());
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+	    listen(fd, SOMAXCONN) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+bool serve(std::string const &path, usize jobs) {
+	struct pool                  pool;
+	std::vector<std::thread>     threads;
+	std::list<struct connection> connections;
+	struct sigaction             action;
+	int                          listener;
+	int                          fd;
+	usize                        i;
+
+	listener = listen_on(path);
+	if (listener < 0) {
+		return false;
+	}
+
+	/* pas de SA_RESTART : accept() est interrompu par le signal */
+	std::memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	pool.stop = false;
+	pool.metrics.connections = 0;
+	pool.metrics.refused     = 0;
+	pool.metrics.batches     = 0;
+	pool.metrics.requests    = 0;
+	pool.metrics.errors      = 0;
+	pool.metrics.latency     = 0;
+	pool.metrics.max_latency = 0;
+	for (i = 0; i < latency_buckets; ++i) {
+		pool.metrics.histogram[i] = 0;
+	}
+
+	if (jobs == 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (i = 0; i < jobs; ++i) {
+		threads.push_back(start_thread(work, std::ref(pool)));
+	}
+
+	while (!stopping) {
+		fd = accept(listener, NULL, NULL);
+		if (fd < 0) {
+			continue;
+		}
+
+		reap(connections);
+		if (connections.size() >= max_connections) {
+			++pool.metrics.refused;
+			close(fd);
+			continue;
+		}
+
+		connections.emplace_back();
+		connections.back().fd       = fd;
+		connections.back().finished = false;
+		connections.back().thread =
+			start_thread(serve_connection, std::ref(connections.back()),
+			             std::ref(pool));
+	}
+
+	close(listener);
+	unlink(path.c_str());
+
+	/* les connexions ouvertes sont interrompues : un lot en cours est encore
+	 * depouille par les fils d'execution, mais sa reponse n'est pas envoyee.
+	 * Elles sont attendues avant d'arreter la file qu'elles utilisent. */
+	for (struct connection &connection : connections) {
+		shutdown(connection.fd, SHUT_RDWR);
+	}
+	for (struct connection &connection : connections) {
+		connection.thread.join();
+		close(connection.fd);
+	}
+	connections.clear();
+
+	print_metrics(std::cerr, pool.metrics);
+
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+
+		pool.stop = true;
+	}
+	pool.ready.notify_all();
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	return true;
+}
+} // namespace vote::server
@@ -0,0 +1,1016 @@
+/**
+ * @author Filip-Daniel Danu
+ * @brief  Noyaux de depouillement specialises selon la forme des classements
+ */
+#include "libvote.hh"
+
+#include <algorithm>
+#include <thread>
+
+namespace vote::tally {
+/**
+ * Longueur de classement commune a tous les participants, mais connue
+ * seulement a l'execution
+ */
+static u32 const dynamic = ~(u32)0;
+
+template <typename T> static T const *get_ids(struct ranks const &ranks);
+
+template <> u8 const *get_ids<u8>(struct ranks const &ranks) {
+	return ranks.ids8.data();
+}
+
+template <> u16 const *get_ids<u16>(struct ranks const &ranks) {
+	return ranks.ids16.data();
+}
+
+template <> u32 const *get_ids<u32>(struct ranks const &ranks) {
+	return ranks.ids32.data();
+}
+
+template <typename W> static W const *get_words(struct ranks const &ranks);
+
+template <> u16 const *get_words<u16>(struct ranks const &ranks) {
+	return ranks.words16.data();
+}
+
+template <> u32 const *get_words<u32>(struct ranks const &ranks) {
+	return ranks.words32.data();
+}
+
+template <> u64 const *get_words<u64>(struct ranks const &ranks) {
+	return ranks.words64.data();
+}
+
+/**
+ * Nombre maximal de glaces pour des classements compacts : un identifiant
+ * doit tenir sur 4 bits, 0 marquant la fin du classement
+ */
+static usize const packed_candidates = 15;
+
+/**
+ * Tables du premier et du dernier choix non elimine parmi les deux glaces
+ * d'un octet d'un classement compact (bits de poids faible en premier), 0 si
+ * aucune des deux n'est en lice
+ */
+struct byte_tables {
+	u8 first[256];
+	u8 last[256];
+	/**
+	 * Glaces non eliminees, indexees par identifiant sur 4 bits
+	 */
+	u8 active[16];
+
+	byte_tables(struct ballot const &ballot, u8 const *ids) {
+		usize size = std::min<usize>(ballot.candidates.size() + 1, 16);
+		usize i;
+
+		std::fill(active, active + 16, 0);
+		std::copy(ids, ids + size, active);
+
+		for (i = 0; i < 256; ++i) {
+			u8 low  = i & 15;
+			u8 high = i >> 4;
+
+			first[i] = active[low] ? low : (active[high] ? high : 0);
+			last[i]  = active[high] ? high : (active[low] ? low : 0);
+		}
+	}
+};
+
+/**
+ * Trouve le classement d'un participant. Si <code>N</code> est 0, les
+ * classements sont de longueur variable et on passe par le participant ;
+ * sinon ils sont tous contigus et de la meme longueur.
+ *
+ * @param ballot  Le vote
+ * @param ids     Les identifiants de <code>ballot.ranks</code>
+ * @param i       Indice du participant dans <code>ballot.roll</code>
+ * @param length  Nombre de glaces classees par le participant
+ * @return  Le premier identifiant du classement
+ */
+template <typename T, u32 N>
+static inline T const *get_ranking(struct ballot const &ballot, T const *ids,
+                                   usize i, u32 &length) {
+	if (N == 0) {
+		struct participant const &participant = ballot.roll->participants[i];
+
+		length = participant.vote_count;
+		return ids + participant.first_vote;
+	}
+
+	length = N == dynamic ? ballot.ranks->length : N;
+	return ids + i * length;
+}
+
+/**
+ * Glaces non eliminees d'un vote, indexees par leur identifiant
+ */
+static void get_active(struct ballot const &ballot, std::vector<u8> &active) {
+	active.assign(ballot.candidates.size() + 1, 0);
+
+	for (struct candidate const &candidate : ballot.candidates) {
+		active[candidate.id] = !candidate.eliminated;
+	}
+}
+
+/**
+ * Indique si le premier tour deja compte peut remplacer le depouillement :
+ * aucune glace n'est eliminee et on ne compte pas un echantillon
+ */
+static bool is_first_round(struct ballot const      &ballot,
+                           std::vector<usize> const &cache,
+                           std::vector<u8> const    &active) {
+	usize i;
+
+	if (!ballot.sample.empty() || cache.size() != active.size()) {
+		return false;
+	}
+
+	for (i = 1; i < active.size(); ++i) {
+		if (!active[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Decomptes deja calcules pour les glaces non eliminees d'un vote, crees vides
+ * au premier appel
+ *
+ * @return  Les decomptes, ou un pointeur nul si le vote ne les garde pas
+ */
+static struct checkpoint *find_checkpoint(struct ballot const   &ballot,
+                                          std::vector<u8> const &active) {
+	if (!ballot.checkpoints || !ballot.sample.empty()) {
+		return nullptr;
+	}
+
+	return &ballot.checkpoints
+	            ->rounds[std::string(active.begin(), active.end())];
+}
+
+/**
+ * Premier choix non elimine. Quand la longueur est connue a la compilation,
+ * la boucle est deroulee et sans branchement ; les participants dont toutes
+ * les glaces sont eliminees sont comptes dans la case 0, ignoree.
+ */
+struct first_choice {
+	struct ballot const &ballot;
+	u8 const            *active;
+	usize               *votes;
+
+	template <typename T, u32 N> void run() const {
+		T const *ids = get_ids<T>(*ballot.ranks);
+		usize    n   = participant_count(ballot);
+		usize    i;
+
+		for (i = 0; i < n; ++i) {
+			usize    j = ballot.sample.empty() ? i : ballot.sample[i];
+			u32      length;
+			T const *ranking = get_ranking<T, N>(ballot, ids, j, length);
+			u32      rank;
+			T        id;
+
+			if (N != 0 && N != dynamic) {
+				for (id = 0, rank = N; rank-- > 0;) {
+					id = active[ranking[rank]] ? ranking[rank] : id;
+				}
+			} else {
+				for (id = 0, rank = 0; rank < length; ++rank) {
+					if (active[ranking[rank]]) {
+						id = ranking[rank];
+						break;
+					}
+				}
+			}
+
+			++votes[id];
+		}
+	}
+
+	template <typename W> void run_words() const {
+		W const           *words = get_words<W>(*ballot.ranks);
+		struct byte_tables tables(ballot, active);
+		usize              n = participant_count(ballot);
+		usize              i;
+
+		for (i = 0; i < n; ++i) {
+			W  word = words[ballot.sample.empty() ? i : ballot.sample[i]];
+			u8 id   = 0;
+
+			/* les octets sont lus dans l'ordre du classement jusqu'a une
+			 * glace en lice ou la fin du classement */
+			while (word != 0 && (id = tables.first[word & 0xff]) == 0) {
+				word >>= 8;
+			}
+
+			++votes[id];
+		}
+	}
+};
+
+/**
+ * Premier choix non elimine et report de voix. <code>state</code> vaut 1
+ * pour une glace non eliminee, <code>i + 2</code> pour la glace
+ * <code>eliminated[i]</code> qui vient d'etre eliminee, et 0 pour une glace
+ * eliminee plus tot. Le premier choix du tour precedent est la premiere glace
+ * d'etat non nul : si elle vient d'etre eliminee, la voix est reportee.
+ */
+struct first_transfer {
+	struct ballot const &ballot;
+	u32 const           *state;
+	usize               *votes;
+	usize               *transfers;
+	usize                size;
+
+	template <typename T, u32 N> void run() const {
+		T const *ids = get_ids<T>(*ballot.ranks);
+		usize    n   = participant_count(ballot);
+		usize    i;
+
+		for (i = 0; i < n; ++i) {
+			usize    j = ballot.sample.empty() ? i : ballot.sample[i];
+			u32      length;
+			T const *ranking = get_ranking<T, N>(ballot, ids, j, length);
+			u32      rank;
+			u32      from;
+			T        id;
+
+			for (id = 0, from = 0, rank = 0; rank < length; ++rank) {
+				u32 s = state[ranking[rank]];
+
+				if (s == 1) {
+					id = ranking[rank];
+					break;
+				}
+				if (s > 1 && from == 0) {
+					from = s - 1;
+				}
+			}
+
+			++votes[id];
+			if (from > 0) {
+				++transfers[(from - 1) * size + id];
+			}
+		}
+	}
+
+	template <typename W> void run_words() const {
+		W const *words = get_words<W>(*ballot.ranks);
+		usize    n     = participant_count(ballot);
+		usize    i;
+
+		for (i = 0; i < n; ++i) {
+			W   word = words[ballot.sample.empty() ? i : ballot.sample[i]];
+			u32 from;
+			u8  id;
+
+			for (id = 0, from = 0; word != 0; word >>= 4) {
+				u32 s = state[word & 15];
+
+				if (s == 1) {
+					id = word & 15;
+					break;
+				}
+				if (s > 1 && from == 0) {
+					from = s - 1;
+				}
+			}
+
+			++votes[id];
+			if (from > 0) {
+				++transfers[(from - 1) * size + id];
+			}
+		}
+	}
+};
+
+/**
+ * Dernier choix non elimine, meme principe que first_choice
+ */
+struct last_choice {
+	struct ballot const &ballot;
+	u8 const            *active;
+	usize               *votes;
+
+	template <typename T, u32 N> void run() const {
+		T const *ids = get_ids<T>(*ballot.ranks);
+		usize    n   = participant_count(ballot);
+		usize    i;
+
+		for (i = 0; i < n; ++i) {
+			usize    j = ballot.sample.empty() ? i : ballot.sample[i];
+			u32      length;
+			T const *ranking = get_ranking<T, N>(ballot, ids, j, length);
+			u32      rank;
+			T        id;
+
+			if (N != 0 && N != dynamic) {
+				for (id = 0, rank = 0; rank < N; ++rank) {
+					id = active[ranking[rank]] ? ranking[rank] : id;
+				}
+			} else {
+				for (id = 0, rank = length; rank-- > 0;) {
+					if (active[ranking[rank]]) {
+						id = ranking[rank];
+						break;
+					}
+				}
+			}
+
+			++votes[id];
+		}
+	}
+
+	template <typename W> void run_words() const {
+		W const           *words = get_words<W>(*ballot.ranks);
+		struct byte_tables tables(ballot, active);
+		usize              n = participant_count(ballot);
+		usize              i;
+
+		for (i = 0; i < n; ++i) {
+			W   word = words[ballot.sample.empty() ? i : ballot.sample[i]];
+			u32 shift;
+			u8  id;
+
+			/* les octets sont lus depuis la fin du mot, ceux apres la fin du
+			 * classement sont nuls */
+			for (id = 0, shift = 8 * sizeof(W); id == 0 && shift > 0;) {
+				shift -= 8;
+				id = tables.last[(word >> shift) & 0xff];
+			}
+
+			++votes[id];
+		}
+	}
+};
+
+/**
+ * Choix a un rang donne, s'il n'est pas elimine
+ */
+struct rank_choice {
+	struct ballot const &ballot;
+	u8 const            *active;
+	usize               *votes;
+	u32                  rank;
+
+	template <typename T, u32 N> void run() const {
+		T const *ids = get_ids<T>(*ballot.ranks);
+		usize    n   = participant_count(ballot);
+		usize    i;
+
+		for (i = 0; i < n; ++i) {
+			usize    j = ballot.sample.empty() ? i : ballot.sample[i];
+			u32      length;
+			T const *ranking = get_ranking<T, N>(ballot, ids, j, length);
+			T        id      = rank < length ? ranking[rank] : 0;
+
+			++votes[active[id] ? id : 0];
+		}
+	}
+
+	template <typename W> void run_words() const {
+		W const *words = get_words<W>(*ballot.ranks);
+		usize    n     = participant_count(ballot);
+		usize    i;
+
+		for (i = 0; i < n; ++i) {
+			W  word = words[ballot.sample.empty() ? i : ballot.sample[i]];
+			u8 id   = rank < 2 * sizeof(W) ? (word >> (4 * rank)) & 15 : 0;
+
+			++votes[active[id] ? id : 0];
+		}
+	}
+};
+
+/**
+ * Paires (vote du premier tour, vote du second tour) des participants
+ * <code>begin</code> a <code>end</code>, pour des classements de longueur 2
+ */
+struct pair_choice {
+	struct ballot const &ballot;
+	usize               *matrix;
+	usize                size;
+	usize                begin;
+	usize                end;
+
+	template <typename T> void run() const {
+		T const *ids = get_ids<T>(*ballot.ranks);
+		usize    i;
+
+		for (i = begin; i < end; ++i) {
+			T const *ranking =
+				ids + 2 * (ballot.sample.empty() ? i : ballot.sample[i]);
+
+			++matrix[ranking[0] * size + ranking[1]];
+		}
+	}
+
+	template <typename W> void run_words() const {
+		W const *words = get_words<W>(*ballot.ranks);
+		usize    i;
+
+		for (i = begin; i < end; ++i) {
+			W word = words[ballot.sample.empty() ? i : ballot.sample[i]];
+
+			++matrix[(word & 15) * size + ((word >> 4) & 15)];
+		}
+	}
+};
+
+/**
+ * Applique une fonction sur tous les classements d'un vote : en une fois s'ils
+ * sont en memoire, sinon morceau par morceau pendant la lecture du fichier
+ * (voir disk::scan())
+ */
+template <typename F>
+static void for_each_chunk(struct ballot const &ballot, F const &f) {
+	if (ballot.ranks->spill) {
+		disk::scan(ballot, f);
+	} else {
+		f(ballot);
+	}
+}
+
+/**
+ * Nombre minimal de participants par fil d'execution pour count_pairs()
+ */
+static usize const pairs_chunk = 1 << 20;
+
+/**
+ * Choisit la specialisation d'un noyau selon la longueur des classements
+ */
+template <typename T, typename K>
+static void dispatch_length(struct ranks const &ranks, K const &kernel) {
+	switch (ranks.length) {
+	case 0:
+		kernel.template run<T, 0>();
+		break;
+	case 2:
+		kernel.template run<T, 2>();
+		break;
+	case 3:
+		kernel.template run<T, 3>();
+		break;
+	case 4:
+		kernel.template run<T, 4>();
+		break;
+	default:
+		kernel.template run<T, dynamic>();
+		break;
+	}
+}
+
+/**
+ * Choisit la specialisation d'un noyau pour des classements compacts
+ *
+ * @return  Valeur booleenne indiquant que les classements sont compacts
+ */
+template <typename K>
+static bool dispatch_words(struct ranks const &ranks, K const &kernel) {
+	switch (ranks.word) {
+	case 2:
+		kernel.template run_words<u16>();
+		return true;
+	case 4:
+		kernel.template run_words<u32>();
+		return true;
+	case 8:
+		kernel.template run_words<u64>();
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Choisit la specialisation d'un noyau selon la taille des identifiants
+ */
+template <typename K>
+static void dispatch(struct ranks const &ranks, K const &kernel) {
+	if (dispatch_words(ranks, kernel)) {
+		return;
+	}
+
+	switch (ranks.width) {
+	case 1:
+		dispatch_length<u8>(ranks, kernel);
+		break;
+	case 2:
+		dispatch_length<u16>(ranks, kernel);
+		break;
+	default:
+		dispatch_length<u32>(ranks, kernel);
+		break;
+	}
+}
+
+/**
+ * Choisit la specialisation d'un noyau qui ne depend que de la taille des
+ * identifiants
+ */
+template <typename K>
+static void dispatch_width(struct ranks const &ranks, K const &kernel) {
+	if (dispatch_words(ranks, kernel)) {
+		return;
+	}
+
+	switch (ranks.width) {
+	case 1:
+		kernel.template run<u8>();
+		break;
+	case 2:
+		kernel.template run<u16>();
+		break;
+	default:
+		kernel.template run<u32>();
+		break;
+	}
+}
+
+/**
+ * Nombre minimal de participants verifies par chaque fil d'execution
+ */
+static usize const check_chunk = 1 << 18;
+
+/**
+ * Nombre maximal de participants refuses gardes dans une validation
+ */
+static usize const kept_rejections = 16;
+
+u32 find_invalid(i32 const *ranking, u32 count, usize candidate_count,
+                 u64 *seen) {
+	u64 mask;
+	u32 j;
+	u32 k;
+
+	/* moins de 64 glaces : l'ensemble tient dans un registre */
+	if (candidate_count < 64) {
+		for (j = 0, mask = 0; j < count; ++j) {
+			i32 id = ranking[j];
+
+			if (id < 1 || (usize)id > candidate_count ||
+			    (mask & ((u64)1 << id)) != 0) {
+				break;
+			}
+			mask |= (u64)1 << id;
+		}
+
+		return j;
+	}
+
+	for (j = 0; j < count; ++j) {
+		i32 id = ranking[j];
+
+		if (id < 1 || (usize)id > candidate_count ||
+		    (seen[id >> 6] & ((u64)1 << (id & 63))) != 0) {
+			break;
+		}
+		seen[id >> 6] |= (u64)1 << (id & 63);
+	}
+
+	/* seuls les mots touches par le classement sont remis a zero */
+	for (k = 0; k < j; ++k) {
+		seen[ranking[k] >> 6] = 0;
+	}
+
+	return j;
+}
+
+/**
+ * Cherche le premier identifiant qui ne correspond a aucune glace, sans
+ * refuser les glaces classees deux fois
+ */
+static u32 find_unknown(i32 const *ranking, u32 count,
+                        usize candidate_count) {
+	u32 j;
+
+	for (j = 0; j < count; ++j) {
+		if (ranking[j] < 1 || (usize)ranking[j] > candidate_count) {
+			break;
+		}
+	}
+
+	return j;
+}
+
+void reject(struct validation &validation, usize participant, u32 line,
+            i32 const *ranking, u32 rank, usize candidate_count) {
+	i32 id = ranking[rank];
+
+	++validation.rejected;
+	if (validation.rejections.size() < kept_rejections) {
+		validation.rejections.push_back(
+			{participant, line, rank + 1, id,
+		     id >= 1 && (usize)id <= candidate_count});
+	}
+}
+
+void merge(struct validation &validation, struct validation const &other) {
+	validation.rejected += other.rejected;
+
+	for (struct rejection const &rejection : other.rejections) {
+		if (validation.rejections.size() < kept_rejections) {
+			validation.rejections.push_back(rejection);
+		}
+	}
+}
+
+/**
+ * Compte un participant refuse d'une liste
+ */
+static void reject(struct validation &validation, struct roll const &roll,
+                   usize i, u32 rank, usize candidate_count) {
+	struct participant const &participant = roll.participants[i];
+
+	reject(validation, i, participant.line,
+	       get_votes(roll, participant), rank, candidate_count);
+}
+
+/**
+ * Noyau de verification des participants de <code>begin</code> a
+ * <code>end</code>, voir check_all()
+ */
+template <typename T>
+using kernel = void (*)(struct roll const &roll, usize candidate_count,
+                        bool unique, usize begin, usize end, T *output,
+                        struct validation &validation);
+
+/**
+ * Verifie les classements des participants de <code>begin</code> a
+ * <code>end</code> et recopie leurs identifiants sur <code>T</code>
+ */
+template <typename T>
+static void narrow(struct roll const &roll, usize candidate_count, bool unique,
+                   usize begin, usize end, T *ids,
+                   struct validation &validation) {
+	std::vector<u64> seen(candidate_count / 64 + 1, 0);
+	usize            i;
+	u32              j;
+
+	for (i = begin; i < end; ++i) {
+		struct participant const &participant = roll.participants[i];
+		i32 const                *ranking     = get_votes(roll, participant);
+		u32                       count       = participant.vote_count;
+
+		j = unique ? find_invalid(ranking, count, candidate_count, seen.data())
+		           : find_unknown(ranking, count, candidate_count);
+		if (j < count) {
+			reject(validation, roll, i, j, candidate_count);
+			continue;
+		}
+
+		for (j = 0; j < count; ++j) {
+			ids[participant.first_vote + j] = (T)ranking[j];
+		}
+	}
+}
+
+/**
+ * Verifie les classements des participants de <code>begin</code> a
+ * <code>end</code> et range chacun dans un mot, 4 bits par glace
+ */
+template <typename W>
+static void pack(struct roll const &roll, usize candidate_count, bool unique,
+                 usize begin, usize end, W *words,
+                 struct validation &validation) {
+	usize i;
+	u32   j;
+
+	for (i = begin; i < end; ++i) {
+		struct participant const &participant = roll.participants[i];
+		i32 const                *ranking     = get_votes(roll, participant);
+		u32                       count       = participant.vote_count;
+		W                         word        = 0;
+
+		/* au plus 15 glaces : find_invalid() n'utilise pas seen */
+		j = unique ? find_invalid(ranking, count, candidate_count, nullptr)
+		           : find_unknown(ranking, count, candidate_count);
+		if (j < count) {
+			reject(validation, roll, i, j, candidate_count);
+			continue;
+		}
+
+		for (j = count; j-- > 0;) {
+			word = (word << 4) | (W)ranking[j];
+		}
+
+		words[i] = word;
+	}
+}
+
+/**
+ * Applique un noyau de verification, narrow() ou pack(), a tous les
+ * participants, decoupes en morceaux verifies en parallele pour les grandes
+ * listes
+ *
+ * @param roll             La liste des participants
+ * @param candidate_count  Nombre de glaces
+ * @param unique           Indique que les glaces classees deux fois sont
+ *                         refusees
+ * @param output           Les identifiants ou les mots du noyau
+ * @param check            Le noyau
+ * @param validation       Les participants refuses, dans l'ordre de la liste
+ * @return  Valeur booleenne indiquant qu'aucun participant n'a ete refuse
+ */
+template <typename T>
+static bool check_all(struct roll const &roll, usize candidate_count,
+                      bool unique, T *output, kernel<T> check,
+                      struct validation &validation) {
+	std::vector<struct validation> chunks;
+	std::vector<std::thread>       threads;
+	usize                          n = roll.participants.size();
+	usize                          jobs;
+	usize                          i;
+
+	validation.rejected = 0;
+	validation.rejections.clear();
+
+	jobs = std::min<usize>(std::max(1u, std::thread::hardware_concurrency()),
+	                       std::max<usize>(n / check_chunk, 1));
+
+	if (jobs == 1) {
+		check(roll, candidate_count, unique, 0, n, output, validation);
+		return validation.rejected == 0;
+	}
+
+	chunks.resize(jobs);
+
+	for (i = 0; i < jobs; ++i) {
+		threads.emplace_back(check, std::cref(roll), candidate_count, unique,
+		                     n * i / jobs, n * (i + 1) / jobs, output,
+		                     std::ref(chunks[i]));
+	}
+
+	for (i = 0; i < jobs; ++i) {
+		threads[i].join();
+	}
+
+	for (struct validation const &chunk : chunks) {
+		merge(validation, chunk);
+	}
+
+	return validation.rejected == 0;
+}
+
+bool get_ranks(struct roll const &roll, usize candidate_count, bool unique,
+               struct ranks &ranks, struct validation &validation) {
+	usize votes = roll.votes.size();
+	u32   longest;
+	usize i;
+
+	/* la longueur commune et la plus longue en un seul passage */
+	ranks.length = 0;
+	if (!roll.participants.empty()) {
+		ranks.length = roll.participants[0].vote_count;
+	}
+
+	longest = 0;
+	for (i = 0; i < roll.participants.size(); ++i) {
+		struct participant const &participant = roll.participants[i];
+
+		if (participant.vote_count != ranks.length ||
+		    participant.first_vote != i * ranks.length) {
+			ranks.length = 0;
+		}
+		longest = std::max(longest, participant.vote_count);
+	}
+
+	ranks.word = 0;
+
+	/* chaque classement est verifie au moment ou il est recopie, puis range
+	 * dans un mot si c'est possible */
+	if (candidate_count <= packed_candidates && longest <= 16) {
+		ranks.width = 1;
+
+		if (longest <= 4) {
+			ranks.word = 2;
+			ranks.words16.resize(roll.participants.size());
+			return check_all(roll, candidate_count, unique,
+			                 ranks.words16.data(), pack<u16>, validation);
+		} else if (longest <= 8) {
+			ranks.word = 4;
+			ranks.words32.resize(roll.participants.size());
+			return check_all(roll, candidate_count, unique,
+			                 ranks.words32.data(), pack<u32>, validation);
+		} else {
+			ranks.word = 8;
+			ranks.words64.resize(roll.participants.size());
+			return check_all(roll, candidate_count, unique,
+			                 ranks.words64.data(), pack<u64>, validation);
+		}
+	}
+
+	if (candidate_count <= UINT8_MAX) {
+		ranks.width = 1;
+		ranks.ids8.resize(votes);
+		return check_all(roll, candidate_count, unique, ranks.ids8.data(),
+		                 narrow<u8>, validation);
+	} else if (candidate_count <= UINT16_MAX) {
+		ranks.width = 2;
+		ranks.ids16.resize(votes);
+		return check_all(roll, candidate_count, unique, ranks.ids16.data(),
+		                 narrow<u16>, validation);
+	} else {
+		ranks.width = 4;
+		ranks.ids32.resize(votes);
+		return check_all(roll, candidate_count, unique, ranks.ids32.data(),
+		                 narrow<u32>, validation);
+	}
+}
+
+std::vector<u8> unpack(struct roll const &roll, struct ranks const &ranks) {
+	std::vector<u8> ids;
+	usize           i;
+	u32             j;
+
+	for (i = 0; i < roll.participants.size(); ++i) {
+		u64 word = ranks.word == 2   ? ranks.words16[i]
+		           : ranks.word == 4 ? ranks.words32[i]
+		                             : ranks.words64[i];
+
+		for (j = 0; j < roll.participants[i].vote_count; ++j, word >>= 4) {
+			ids.push_back(word & 15);
+		}
+	}
+
+	return ids;
+}
+
+void count_first(struct ballot const &ballot, std::vector<usize> &votes) {
+	std::vector<u8>    active;
+	struct checkpoint *checkpoint;
+
+	get_active(ballot, active);
+	if (is_first_round(ballot, ballot.first_round.votes, active)) {
+		votes = ballot.first_round.votes;
+		return;
+	}
+
+	checkpoint = find_checkpoint(ballot, active);
+	if (checkpoint != nullptr && !checkpoint->votes.empty()) {
+		votes = checkpoint->votes;
+		return;
+	}
+
+	votes.assign(active.size(), 0);
+	for_each_chunk(ballot, [&](struct ballot const &chunk) {
+		dispatch(*chunk.ranks,
+		         first_choice{chunk, active.data(), votes.data()});
+	});
+
+	if (checkpoint != nullptr) {
+		checkpoint->votes = votes;
+		++ballot.checkpoints->scans;
+	}
+}
+
+void count_transfers(struct ballot const    &ballot,
+                     std::vector<i32> const &eliminated,
+                     std::vector<usize>     &votes,
+                     std::vector<usize>     &transfers) {
+	std::vector<u32>   state;
+	std::vector<u8>    active;
+	struct checkpoint *checkpoint;
+	usize              size = ballot.candidates.size() + 1;
+	usize              i;
+
+	get_active(ballot, active);
+	checkpoint = find_checkpoint(ballot, active);
+	if (checkpoint != nullptr && !checkpoint->votes.empty()) {
+		auto it = checkpoint->transfers.find(eliminated);
+
+		if (it != checkpoint->transfers.end()) {
+			votes     = checkpoint->votes;
+			transfers = it->second;
+			return;
+		}
+	}
+
+	state.assign(size, 0);
+	for (struct candidate const &candidate : ballot.candidates) {
+		state[candidate.id] = !candidate.eliminated;
+	}
+	for (i = 0; i < eliminated.size(); ++i) {
+		state[eliminated[i]] = i + 2;
+	}
+
+	votes.assign(size, 0);
+	transfers.assign(eliminated.size() * size, 0);
+	for_each_chunk(ballot, [&](struct ballot const &chunk) {
+		dispatch(*chunk.ranks,
+		         first_transfer{chunk, state.data(), votes.data(),
+		                        transfers.data(), size});
+	});
+
+	if (checkpoint != nullptr) {
+		checkpoint->votes                 = votes;
+		checkpoint->transfers[eliminated] = transfers;
+		++ballot.checkpoints->scans;
+	}
+}
+
+void count_last(struct ballot const &ballot, std::vector<usize> &votes) {
+	std::vector<u8>    active;
+	struct checkpoint *checkpoint;
+
+	get_active(ballot, active);
+	if (is_first_round(ballot, ballot.first_round.last_votes, active)) {
+		votes = ballot.first_round.last_votes;
+		return;
+	}
+
+	checkpoint = find_checkpoint(ballot, active);
+	if (checkpoint != nullptr && !checkpoint->last_votes.empty()) {
+		votes = checkpoint->last_votes;
+		return;
+	}
+
+	votes.assign(active.size(), 0);
+	for_each_chunk(ballot, [&](struct ballot const &chunk) {
+		dispatch(*chunk.ranks, last_choice{chunk, active.data(), votes.data()});
+	});
+
+	if (checkpoint != nullptr) {
+		checkpoint->last_votes = votes;
+		++ballot.checkpoints->scans;
+	}
+}
+
+void count_pairs(struct ballot const &ballot, std::vector<usize> &matrix) {
+	std::vector<std::vector<usize>> chunks;
+	std::vector<std::thread>        threads;
+	usize                           size = ballot.candidates.size() + 1;
+	usize                           n    = participant_count(ballot);
+	usize                           jobs;
+	usize                           i;
+	usize                           j;
+
+	if (ballot.sample.empty() &&
+	    ballot.first_round.pairs.size() == size * size) {
+		matrix = ballot.first_round.pairs;
+		return;
+	}
+
+	matrix.assign(size * size, 0);
+
+	if (n > 0 && ballot.ranks->length != 2) {
+		return;
+	}
+
+	/* un vote deverse sur disque est lu sequentiellement, sans decoupage */
+	if (ballot.ranks->spill) {
+		disk::scan(ballot, [&](struct ballot const &chunk) {
+			dispatch_width(*chunk.ranks,
+			               pair_choice{chunk, matrix.data(), size, 0,
+			                           participant_count(chunk)});
+		});
+		return;
+	}
+
+	/* les gros votes sont decoupes en morceaux comptes en parallele, chacun
+	 * dans sa propre matrice */
+	jobs = std::min<usize>(std::max(1u, std::thread::hardware_concurrency()),
+	                       std::max<usize>(n / pairs_chunk, 1));
+
+	if (jobs == 1) {
+		dispatch_width(*ballot.ranks,
+		               pair_choice{ballot, matrix.data(), size, 0, n});
+		return;
+	}
+
+	chunks.assign(jobs, std::vector<usize>(matrix.size(), 0));
+
+	for (i = 0; i < jobs; ++i) {
+		pair_choice kernel{ballot, chunks[i].data(), size, n * i / jobs,
+		                   n * (i + 1) / jobs};
+
+		threads.emplace_back([kernel, &ballot]() {
+			dispatch_width(*ballot.ranks, kernel);
+		});
+	}
+
+	for (i = 0; i < jobs; ++i) {
+		threads[i].join();
+
+		for (j = 0; j < matrix.size(); ++j) {
+			matrix[j] += chunks[i][j];
+		}
+	}
+}
+
+void count_rank(struct ballot const &ballot, u32 rank,
+                std::vector<usize> &votes) {
+	std::vector<u8> active;
+
+	get_active(ballot, active);
+	votes.assign(active.size(), 0);
+	for_each_chunk(ballot, [&](struct ballot const &chunk) {
+		dispatch(*chunk.ranks,
+		         rank_choice{chunk, active.data(), votes.data(), rank});
+	});
+}
+} // namespace vote::tally
@@ -0,0 +1,10 @@
+TEMPLATE = lib
+CONFIG += shared c++11 thread
+CONFIG -= qt
+TARGET = vote
+VERSION = 1.0.0
+INCLUDEPATH += ../libvote
+# seule l'interface C (libvote.h) est exportee
+DEFINES += VOTE_BUILD_SHARED
+QMAKE_CXXFLAGS += -fvisibility=hidden -fvisibility-inlines-hidden
+include(../libvote/libvote.pri)
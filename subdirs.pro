@@ -1,6 +1,7 @@
 TEMPLATE = subdirs
 SUBDIRS = \
           libvote \
+          libvote_shared \
           vote \
           vote_alternatif \
           vote_majoritaire \
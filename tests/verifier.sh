@@ -0,0 +1,41 @@
+#!/bin/sh
+# Compare la sortie de vote avec les oracles de chaque dossier de tests :
+# entreeN est lue sur l'entree standard avec les arguments de optionsN.txt
+# (le nom du dossier s'il n'existe pas), la sortie standard doit etre
+# oracleN.txt et la sortie d'erreur erreurN.txt, s'il existe. Les chemins
+# dans optionsN.txt sont relatifs a la racine du depot.
+#
+# usage : tests/verifier.sh [VOTE]
+
+vote=${1:-./out/vote/vote}
+tests=$(dirname "$0")
+sortie=$(mktemp)
+erreur=$(mktemp)
+status=0
+
+for entree in "$tests"/*/entree*; do
+	dossier=${entree%/*}
+	n=${entree##*/entree}
+	n=${n%%.*}
+
+	if [ -f "$dossier/options$n.txt" ]; then
+		options=$(cat "$dossier/options$n.txt")
+	else
+		options=${dossier##*/}
+	fi
+
+	# shellcheck disable=SC2086
+	"$vote" $options <"$entree" >"$sortie" 2>"$erreur"
+
+	if cmp -s "$sortie" "$dossier/oracle$n.txt" &&
+	   { [ ! -f "$dossier/erreur$n.txt" ] ||
+	     cmp -s "$erreur" "$dossier/erreur$n.txt"; }; then
+		echo "ok   $entree"
+	else
+		echo "FAIL $entree"
+		status=1
+	fi
+done
+
+rm -f "$sortie" "$erreur"
+exit $status
@@ -4,15 +4,35 @@
  */
 #include "libvote.hh"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <fstream>
 #include <getopt.h>
 #include <sstream>
 
-char const static optstring[]         = "hgc:";
+char const static optstring[]         = "hgc:bta:s:j:nprdk:m:e:q:u:l:PS:";
 struct option const static longopts[] = {
 	{"help", no_argument, NULL, 'h'},
 	{"generate", no_argument, NULL, 'g'},
 	{"count", required_argument, NULL, 'c'},
+	{"batch", no_argument, NULL, 'b'},
+	{"transfers", no_argument, NULL, 't'},
+	{"analyze", required_argument, NULL, 'a'},
+	{"seed", required_argument, NULL, 's'},
+	{"jobs", required_argument, NULL, 'j'},
+	{"anonymous", no_argument, NULL, 'n'},
+	{"pipeline", no_argument, NULL, 'p'},
+	{"rows", no_argument, NULL, 'r'},
+	{"districts", no_argument, NULL, 'd'},
+	{"cache", required_argument, NULL, 'k'},
+	{"memory", required_argument, NULL, 'm'},
+	{"early", required_argument, NULL, 'e'},
+	{"queries", required_argument, NULL, 'q'},
+	{"audit", required_argument, NULL, 'u'},
+	{"risk-limit", required_argument, NULL, 'l'},
+	{"profile", no_argument, NULL, 'P'},
+	{"serve", required_argument, NULL, 'S'},
 	{NULL, 0, NULL, 0}};
 
 /**
@@ -25,8 +45,14 @@ struct option const static longopts[] = {
 static void usage(char *const arg0) {
 	/* clang-format off */
 	std::cerr
-		<< "usage:  " << arg0 << " [--] ALGORITHM" << std::endl
+		<< "usage:  " << arg0 << " [-b] [-t] [-n] [-P] [-p | -r] [-k DIR | -m MEGABYTES] [--] ALGORITHM" << std::endl
+		<< "        " << arg0 << " -a SAMPLES [-s SEED] [-j JOBS] [-b] [-n] [-p | -r] [-k DIR] [--] ALGORITHM" << std::endl
+		<< "        " << arg0 << " -e TOTAL [-b] [-t] [-n] [--] ALGORITHM" << std::endl
+		<< "        " << arg0 << " -q QUERIES [-b] [-t] [-n] [-p | -r] [-m MEGABYTES] [--] ALGORITHM" << std::endl
+		<< "        " << arg0 << " -d [-j JOBS] [-b] [-n] [-r] [--] ALGORITHM" << std::endl
 		<< "        " << arg0 << " -g [-c COUNT]" << std::endl
+		<< "        " << arg0 << " -u BALLOTS [-s SEED] [-l PERCENT] [-c COUNT]" << std::endl
+		<< "        " << arg0 << " -S SOCKET [-j JOBS]" << std::endl
 		<< std::endl
 		<< "options" << std::endl
 		<< "\t-h, --help  shows this screen" << std::endl
@@ -35,7 +61,93 @@ static void usage(char *const arg0) {
 	    << "\t                using candidate and participant lists from stdin" << std::endl
 	    << std::endl
 		<< "\t-c, --count COUNT  (use with -g) vote for a certain amount" << std::endl
-		<< "\t                   of candidates" << std::endl
+		<< "\t                   of candidates; (use with -u) only lists the" << std::endl
+		<< "\t                   first COUNT draws, to fetch the paper ballots" << std::endl
+		<< std::endl
+		<< "\t-n, --anonymous  ignores the names of the participants while reading" << std::endl
+		<< "\t                 them, to save memory (cannot be used with -g)" << std::endl
+		<< std::endl
+		<< "\t-p, --pipeline  reads the input in a separate thread and counts the" << std::endl
+		<< "\t                first round while it is still arriving (cannot be" << std::endl
+		<< "\t                used with -g)" << std::endl
+		<< std::endl
+		<< "\t-r, --rows  reads one participant per line after the candidates," << std::endl
+		<< "\t            as CSV or TSV: an id then the ranked candidate ids;" << std::endl
+		<< "\t            the first line with a comma or a tab starts the" << std::endl
+		<< "\t            participants, so candidate names cannot hold one" << std::endl
+		<< "\t            (cannot be used with -g, -p or -m)" << std::endl
+		<< std::endl
+		<< "\t-d, --districts  the participants are grouped in blocks, each one" << std::endl
+		<< "\t                 after the name of its district between brackets" << std::endl
+		<< "\t                 on its own line (\"[North]\"); every district" << std::endl
+		<< "\t                 votes on its own, in parallel, then the winners," << std::endl
+		<< "\t                 the seats of each candidate and the national" << std::endl
+		<< "\t                 first round are shown (cannot be used with -g," << std::endl
+		<< "\t                 -p, -k, -m, -t, -q or -a)" << std::endl
+		<< std::endl
+		<< "\t-k, --cache DIR  keeps the parsed votes and the results in DIR and" << std::endl
+		<< "\t                 reuses them when the same input is read again" << std::endl
+		<< "\t                 (cannot be used with -g)" << std::endl
+		<< std::endl
+		<< "\t-m, --memory MEGABYTES  out-of-core mode: spills the votes to a" << std::endl
+		<< "\t                        temporary file and reads it again in each" << std::endl
+		<< "\t                        round, keeping about MEGABYTES of votes in" << std::endl
+		<< "\t                        memory (implies -n and -p, cannot be used" << std::endl
+		<< "\t                        with -g, -a or -k)" << std::endl
+		<< std::endl
+		<< "\t-e, --early TOTAL  the input has TOTAL participants: stops reading" << std::endl
+		<< "\t                   it as soon as a candidate has more than half" << std::endl
+		<< "\t                   of them in the first round, since the rest" << std::endl
+		<< "\t                   cannot change the winner, and shows how many" << std::endl
+		<< "\t                   participants were read. The rest of the input" << std::endl
+		<< "\t                   is not checked (implies -p, cannot be used" << std::endl
+		<< "\t                   with -g, -r, -d, -k, -m, -q or -a)" << std::endl
+		<< std::endl
+		<< "input" << std::endl
+		<< "\tthe input is read from stdin and may be compressed with gzip or" << std::endl
+		<< "\tzstd; compressed inputs are always read as with -p" << std::endl
+		<< std::endl
+		<< "\t-b, --batch  (instant_runoff) eliminate every candidate that can no" << std::endl
+		<< "\t             longer win in a single round" << std::endl
+		<< std::endl
+		<< "\t-t, --transfers  (instant_runoff, ranked) shows where the votes of" << std::endl
+		<< "\t                 each eliminated candidate went in every round" << std::endl
+		<< "\t                 (cannot be used with -a)" << std::endl
+		<< std::endl
+		<< "\t-q, --queries QUERIES  (instant_runoff, ranked) after the vote," << std::endl
+		<< "\t                       reads one what-if query per line from the" << std::endl
+		<< "\t                       file QUERIES (for example /dev/tty): the" << std::endl
+		<< "\t                       ids or names of candidates to withdraw," << std::endl
+		<< "\t                       separated by commas. Rounds already counted" << std::endl
+		<< "\t                       are reused (cannot be used with -a or -k)" << std::endl
+		<< std::endl
+		<< "\t-a, --analyze SAMPLES  resamples the participants SAMPLES times and" << std::endl
+		<< "\t                       shows how often each candidate wins" << std::endl
+		<< "\t-s, --seed SEED        (use with -a or -u) seed of the resampling" << std::endl
+		<< "\t                       or of the draws, 0 by default" << std::endl
+		<< "\t-j, --jobs JOBS        (use with -a, -d or -S) number of threads, all" << std::endl
+		<< "\t                       cores by default" << std::endl
+		<< std::endl
+		<< "\t-P, --profile  counts the heap allocations and bytes of each phase" << std::endl
+		<< "\t               of the run and of each round, samples the resident" << std::endl
+		<< "\t               memory, and prints them on stderr at the end" << std::endl
+		<< "\t               (cannot be used with -g, -d, -u or -S)" << std::endl
+		<< std::endl
+		<< "\t-u, --audit BALLOTS  ballot-polling audit (BRAVO) of the first" << std::endl
+		<< "\t                     round of a vote saved by -k in the file" << std::endl
+		<< "\t                     BALLOTS (DIR/*.ballot): draws participants" << std::endl
+		<< "\t                     at random and reads from stdin the first" << std::endl
+		<< "\t                     choice of each paper ballot, one per line" << std::endl
+		<< "\t                     (an id, 0 for none, or an empty line if it" << std::endl
+		<< "\t                     matches), until the risk limit is met. It" << std::endl
+		<< "\t                     confirms the first-choice leader, who is" << std::endl
+		<< "\t                     not always the winner of a ranked vote" << std::endl
+		<< "\t-l, --risk-limit PERCENT  (use with -u) between 0 and 100, may be" << std::endl
+		<< "\t                          fractional (0.5), 5 by default" << std::endl
+		<< std::endl
+		<< "\t-S, --serve SOCKET  serves votes on the Unix domain socket SOCKET" << std::endl
+		<< "\t                    until SIGINT or SIGTERM, then prints metrics" << std::endl
+		<< "\t                    (the protocol is described in libvote.hh)" << std::endl
 		<< std::endl
 		<< "arguments" << std::endl
 		<< "\tALGORITHM:" << std::endl
@@ -45,16 +157,749 @@ static void usage(char *const arg0) {
 		<< std::endl
 		<< "examples" << std::endl
 		<< "\tcat input1 | " << arg0 << " two_round >output1" << std::endl
+		<< "\tcat input1 | " << arg0 << " -a 10000 -s 42 ranked" << std::endl
 		<< "\tcat input1 | " << arg0 << " -g -c 2 >input2" << std::endl
 		<< std::endl;
 	/* clang-format on */
 }
 
+/**
+ * Lit un nombre entier positif passe en argument
+ *
+ * @param arg     L'argument
+ * @param number  Le nombre renvoye
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+static bool parse_number(char const *arg, u64 &number) {
+	try {
+		number = std::stoull(arg);
+		return true;
+	} catch (std::invalid_argument const &e) {
+		std::cerr << "invalid argument: " << arg << std::endl;
+	} catch (std::out_of_range const &e) {
+		std::cerr << "argument out of range: " << arg << std::endl;
+	}
+	return false;
+}
+
+/**
+ * Lit un nombre reel passe en argument
+ *
+ * @param arg     L'argument
+ * @param number  Le nombre renvoye
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+static bool parse_real(char const *arg, double &number) {
+	try {
+		number = std::stod(arg);
+		return true;
+	} catch (std::invalid_argument const &e) {
+		std::cerr << "invalid argument: " << arg << std::endl;
+	} catch (std::out_of_range const &e) {
+		std::cerr << "argument out of range: " << arg << std::endl;
+	}
+	return false;
+}
+
+/**
+ * Lit les glaces et les participants depuis une entree, qui peut etre
+ * compressee avec gzip ou zstd
+ *
+ * @param source       L'entree, par exemple <code>std::cin</code>
+ * @param seekable     Indique que l'entree est deja en memoire et qu'on peut
+ *                     s'y deplacer : elle n'est alors pas recopiee
+ * @param pipelined    Indique si l'entree est lue avec pipeline::parse().
+ *                     C'est toujours le cas pour une entree compressee, pour
+ *                     ne jamais la garder decompressee en memoire.
+ * @param rows         Indique si l'entree a un participant par ligne et est
+ *                     lue avec rows::parse(), qui ne la garde pas non plus
+ *                     en memoire
+ * @param candidates   Les glaces
+ * @param roll         Les participants
+ * @param first_round  Le premier tour, s'il a ete compte pendant la lecture
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+static bool read_input(std::istream &source, bool seekable, bool pipelined,
+                       bool                                 rows,
+                       std::vector<struct vote::candidate> &candidates,
+                       struct vote::roll                   &roll,
+                       struct vote::first_round            &first_round) {
+	enum vote::input::format      format;
+	std::unique_ptr<std::istream> input;
+	std::stringstream             buffer;
+	std::istream                 *stream;
+
+	input = vote::input::open(source, format);
+	if (!input) {
+		std::cerr << "compressed input is not supported by this build"
+				  << std::endl;
+		return false;
+	}
+
+	if (rows) {
+		if (!vote::rows::parse(*input, candidates, roll) &&
+		    !input->bad()) {
+			std::cerr << "failed to parse input" << std::endl;
+			return false;
+		}
+		if (input->bad()) {
+			std::cerr << "failed to decompress input" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	if (pipelined || format != vote::input::plain) {
+		if (!vote::pipeline::parse(*input, candidates, roll, first_round) &&
+		    !input->bad()) {
+			std::cerr << "failed to parse input" << std::endl;
+			return false;
+		}
+		if (input->bad()) {
+			std::cerr << "failed to decompress input" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	/* on stocke en memoire tout ce qui est contenu dans le flux standard
+	 * d'entree en supposant qu'il redirige vers un fichier on fait cela pour
+	 * pouvoir manipuler le flux avec les methodes tellg() et seekg() de
+	 * std::basic_istream : on copie l'entree directement dans un flux en
+	 * memoire pour l'utiliser avec nos interfaces dans libvote */
+
+	if (seekable) {
+		/* open() a deja lu les premiers octets */
+		source.seekg(0);
+		stream = &source;
+	} else {
+		buffer << input->rdbuf();
+		stream = &buffer;
+	}
+
+	if (!vote::parser::parse_candidates(*stream, candidates, 0)) {
+		std::cerr << "failed to parse candidates" << std::endl;
+		return false;
+	}
+	if (!vote::parser::parse_participants(*stream, roll, 0)) {
+		std::cerr << "failed to parse participants" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Affiche les premiers participants refuses par get_ballot(), avec leur
+ * ligne si elle est connue, puis leur nombre total
+ *
+ * @param stream      Le flux de sortie
+ * @param validation  Les participants refuses
+ */
+static void print_validation(std::ostream                  &stream,
+                             struct vote::validation const &validation) {
+	for (struct vote::rejection const &rejection : validation.rejections) {
+		stream << "invalid ballot";
+		if (rejection.line > 0) {
+			stream << " at line " << rejection.line;
+		}
+		stream << " (participant " << rejection.participant + 1 << "): ";
+
+		if (rejection.duplicate) {
+			stream << "candidate " << rejection.id << " ranked twice";
+		} else {
+			stream << "unknown candidate " << rejection.id;
+		}
+		stream << " at rank " << rejection.rank << std::endl;
+	}
+
+	if (validation.rejected > validation.rejections.size()) {
+		stream << "... " << validation.rejected - validation.rejections.size()
+			   << " more" << std::endl;
+	}
+	stream << validation.rejected << " invalid ballot"
+		   << (validation.rejected > 1 ? "s" : "") << std::endl;
+}
+
+/**
+ * Lit les glaces et les participants depuis l'entree standard en deversant
+ * les participants sur disque au fur et a mesure
+ *
+ * @param budget       Memoire que peuvent occuper les classements relus
+ * @param unique       Indique qu'une glace ne peut etre classee qu'une fois
+ * @param candidates   Les glaces
+ * @param spill        Les participants deverses
+ * @param first_round  Le premier tour, compte pendant la lecture
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+static bool
+spill_input(usize budget, bool unique,
+            std::vector<struct vote::candidate>       &candidates,
+            std::shared_ptr<struct vote::spill const> &spill,
+            struct vote::first_round                  &first_round) {
+	enum vote::input::format      format;
+	std::unique_ptr<std::istream> input;
+	struct vote::validation       validation;
+
+	input = vote::input::open(std::cin, format);
+	if (!input) {
+		std::cerr << "compressed input is not supported by this build"
+				  << std::endl;
+		return false;
+	}
+
+	if (!vote::pipeline::parse(*input, candidates, budget, unique, spill,
+	                           validation, first_round) &&
+	    !input->bad()) {
+		if (validation.rejected > 0) {
+			print_validation(std::cerr, validation);
+			std::cerr << "invalid data" << std::endl;
+		} else {
+			std::cerr << "failed to parse input" << std::endl;
+		}
+		return false;
+	}
+	if (input->bad()) {
+		std::cerr << "failed to decompress input" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Lit les glaces et les participants depuis l'entree standard en s'arretant
+ * des que le premier tour est decide
+ *
+ * @param candidates   Les glaces
+ * @param roll         Les participants lus
+ * @param decision     La decision, avec le nombre total de participants
+ * @param first_round  Le premier tour des participants lus
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+static bool decide_input(std::vector<struct vote::candidate> &candidates,
+                         struct vote::roll                   &roll,
+                         struct vote::decision               &decision,
+                         struct vote::first_round            &first_round) {
+	enum vote::input::format      format;
+	std::unique_ptr<std::istream> input;
+	bool                          success;
+
+	input = vote::input::open(std::cin, format);
+	if (!input) {
+		std::cerr << "compressed input is not supported by this build"
+				  << std::endl;
+		return false;
+	}
+
+	/* un flux endommage apres la decision n'a pas ete lu */
+	success = vote::pipeline::decide(*input, candidates, roll, decision,
+	                                 first_round);
+	if (!success && !input->bad()) {
+		std::cerr << "failed to parse input" << std::endl;
+		return false;
+	}
+	if ((!success || decision.winner == 0) && input->bad()) {
+		std::cerr << "failed to decompress input" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Affiche un premier tour decide avant la fin de l'entree : les tours sur la
+ * sortie d'erreur, comme print_vote(), avec les voix de chaque glace par
+ * rapport au nombre total de participants, puis la glace gagnante
+ *
+ * @param stream       Le flux de sortie
+ * @param candidates   Les glaces
+ * @param decision     La decision
+ * @param first_round  Le premier tour des participants lus
+ */
+static void print_decision(std::ostream                        &stream,
+                           std::vector<struct vote::candidate>  candidates,
+                           struct vote::decision const         &decision,
+                           struct vote::first_round const      &first_round) {
+	for (struct vote::candidate &c : candidates) {
+		c.votes = first_round.votes[c.id];
+	}
+
+	std::stable_sort(candidates.begin(), candidates.end(),
+	                 [](struct vote::candidate const &lhs,
+	                    struct vote::candidate const &rhs) {
+						 return lhs.votes > rhs.votes;
+					 });
+
+	std::cerr << "Round 1 (" << decision.counted << " of " << decision.total
+			  << " participants read)" << std::endl;
+
+	for (struct vote::candidate const &c : candidates) {
+		double frac = (double)c.votes / (double)decision.total;
+
+		if (c.id == decision.winner) {
+			std::cerr << "Winner: ";
+		}
+
+		std::cerr << "(id: " << c.id << ") " << c.name << " (at least "
+				  << std::round(1000 * frac) / 10 << "%): " << c.votes
+				  << " votes" << std::endl;
+	}
+
+	std::cerr << std::endl
+			  << "decided after reading " << decision.counted << " of "
+			  << decision.total << " participants ("
+			  << std::round(1000 * (double)decision.counted /
+	                        (double)decision.total) /
+	                 10
+			  << "%)" << std::endl;
+
+	stream << "c'est la glace " << candidates[0].name << " qui a gagne"
+		   << std::endl;
+}
+
+/**
+ * Affiche un classement
+ */
+static void print_ranking(std::ostream           &stream,
+                          std::vector<i32> const &ranking) {
+	usize i;
+
+	for (i = 0; i < ranking.size(); ++i) {
+		stream << (i > 0 ? " " : "") << ranking[i];
+	}
+}
+
+/**
+ * Audit par sondage d'un vote enregistre par le cache. Les tirages sont
+ * affiches sur la sortie standard et les bulletins papier sont lus sur
+ * l'entree standard, un par ligne.
+ *
+ * @param path   Chemin du vote enregistre
+ * @param seed   Graine des tirages
+ * @param limit  Limite de risque, en pourcentage
+ * @param count  S'il n'est pas nul, on affiche seulement les
+ *               <code>count</code> premiers tirages
+ * @return  Valeur booleenne indiquant que la limite de risque est atteinte,
+ *          ou que les tirages ont ete affiches
+ */
+static bool run_audit(std::string const &path, u64 seed, double limit,
+                      u64 count) {
+	struct vote::ballot_file    file;
+	struct vote::ballot_polling polling;
+	std::vector<i32>            ranking;
+	std::string                 line;
+	u64                         participant;
+	u64                         n;
+	i32                         id;
+	double                      risk;
+
+	if (!vote::cache::open_ballot(path, file) || file.participants == 0) {
+		std::cerr << "failed to open " << path << std::endl;
+		return false;
+	}
+
+	if (!vote::audit::begin(file.first_votes, polling)) {
+		std::cerr << "cannot audit a tie" << std::endl;
+		return false;
+	}
+
+	/* seul le premier tour est enregistre : pour un vote a plusieurs tours,
+	 * la glace en tete n'est pas forcement le gagnant */
+	std::cout << "first-choice leader: (id: " << polling.winner << ") "
+			  << file.candidates[polling.winner - 1].name << ", "
+			  << file.first_votes[polling.winner] << " of "
+			  << file.participants << " first choices" << std::endl;
+
+	for (n = 0; count == 0 || n < count; ++n) {
+		participant = vote::audit::draw(seed, n, file.participants);
+
+		if (!vote::cache::get_ranking(file, participant, ranking)) {
+			std::cerr << "failed to read participant " << participant + 1
+					  << std::endl;
+			return false;
+		}
+
+		std::cout << "ballot " << n + 1 << ": participant " << participant + 1
+				  << ", electronic: ";
+		print_ranking(std::cout, ranking);
+		std::cout << std::endl;
+
+		if (count > 0) {
+			continue;
+		}
+
+		/* une ligne vide confirme le bulletin electronique */
+		for (;;) {
+			if (!std::getline(std::cin, line)) {
+				risk = vote::audit::get_risk(polling);
+				std::cout << "risk limit not met after " << polling.sampled
+						  << " ballots (risk " << std::round(1000 * risk) / 10
+						  << "%)" << std::endl;
+				return false;
+			}
+
+			if (line.find_first_not_of(' ') == std::string::npos) {
+				id = ranking.empty() ? 0 : ranking[0];
+				break;
+			}
+			if (vote::parser::to_int(line, id) && id >= 0 &&
+			    (usize)id <= file.candidates.size()) {
+				break;
+			}
+
+			std::cerr << "invalid first choice: " << line << std::endl;
+		}
+
+		vote::audit::confirm(polling, id);
+		risk = vote::audit::get_risk(polling);
+		std::cout << "risk: " << std::round(1000 * risk) / 10 << "%"
+				  << std::endl;
+
+		if (risk * 100 <= limit) {
+			std::cout << "risk limit of " << limit << "% met after "
+					  << polling.sampled << " ballots" << std::endl;
+			return true;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Termine la derniere phase d'un profil et l'affiche sur la sortie d'erreur
+ *
+ * @param profile       Le profil
+ * @param phase         Nom de la derniere phase
+ * @param participants  Nombre de participants
+ */
+static void print_profile(struct vote::memory_profile &profile,
+                          char const *phase, usize participants) {
+	vote::profile::mark(profile, phase);
+
+	std::cerr << std::endl;
+	vote::profile::print(std::cerr, profile, participants);
+}
+
+/**
+ * Lit tout le contenu d'un flux
+ *
+ * @param stream  Le flux
+ * @param data    Le contenu
+ * @return  Valeur booleenne indicative du succes de la fonction
+ */
+static bool read_all(std::istream &stream, std::string &data) {
+	char            chunk[1 << 16];
+	std::streamsize size;
+
+	while ((size = stream.rdbuf()->sgetn(chunk, sizeof(chunk))) > 0) {
+		data.append(chunk, size);
+	}
+
+	return !stream.bad();
+}
+
+/**
+ * Affiche la probabilite de victoire de chaque glace apres un
+ * reechantillonnage
+ *
+ * @param stream   Le flux de sortie
+ * @param ballot   Le vote
+ * @param wins     Nombre de victoires de chaque glace, indexe par
+ *                 <code>id - 1</code>
+ * @param samples  Nombre d'echantillons
+ */
+static void print_analysis(std::ostream              &stream,
+                           struct vote::ballot const &ballot,
+                           std::vector<usize> const  &wins, usize samples) {
+	std::vector<struct vote::candidate> candidates;
+
+	candidates = ballot.candidates;
+	std::sort(candidates.begin(), candidates.end(),
+	          [&wins](struct vote::candidate const &lhs,
+	                  struct vote::candidate const &rhs) {
+				  return wins[lhs.id - 1] > wins[rhs.id - 1];
+			  });
+
+	for (struct vote::candidate const &c : candidates) {
+		double frac = (double)wins[c.id - 1] / (double)samples;
+
+		stream << "(id: " << c.id << ") " << c.name << ": "
+			   << std::round(1000 * frac) / 10 << "% (" << wins[c.id - 1] << "/"
+			   << samples << " samples)" << std::endl;
+	}
+}
+
+/**
+ * Affiche les reports de voix de chaque tour
+ *
+ * @param stream  Le flux de sortie
+ * @param ballot  Le vote, apres le systeme de votes
+ */
+static void print_transfers(std::ostream &stream, struct vote::ballot &ballot) {
+	for (struct vote::transfer const &t : ballot.transfers) {
+		stream << "Round " << t.round << ": (id: " << t.from << ") "
+			   << vote::find_candidate(ballot, t.from)->name << " -> ";
+
+		if (t.to == 0) {
+			stream << "exhausted";
+		} else {
+			stream << "(id: " << t.to << ") "
+				   << vote::find_candidate(ballot, t.to)->name;
+		}
+
+		stream << ": " << t.votes << " votes" << std::endl;
+	}
+}
+
+/**
+ * Trouve les glaces d'une requete
+ *
+ * @param ballot     Le vote
+ * @param line       La requete : identifiants ou noms separes par des
+ *                   virgules
+ * @param withdrawn  Identifiants des glaces
+ * @return  Valeur booleenne indiquant que toutes les glaces existent
+ */
+static bool parse_query(struct vote::ballot const &ballot,
+                        std::string const &line, std::vector<i32> &withdrawn) {
+	std::istringstream stream(line);
+	std::string        field;
+
+	while (std::getline(stream, field, ',')) {
+		usize begin = field.find_first_not_of(' ');
+		usize end   = field.find_last_not_of(' ');
+		i32   id;
+
+		if (begin == std::string::npos) {
+			continue;
+		}
+		field = field.substr(begin, end - begin + 1);
+
+		if (field.find_first_not_of("0123456789") != std::string::npos ||
+		    !vote::parser::to_int(field, id)) {
+			id = 0;
+			for (struct vote::candidate const &c : ballot.candidates) {
+				if (c.name == field) {
+					id = c.id;
+				}
+			}
+		}
+
+		if (id < 1 || (usize)id > ballot.candidates.size()) {
+			std::cerr << "unknown candidate: " << field << std::endl;
+			return false;
+		}
+
+		withdrawn.push_back(id);
+	}
+
+	return true;
+}
+
+/**
+ * Repond aux requetes d'un fichier : chaque ligne donne les glaces a retirer
+ * du vote et la reponse est affichee des qu'elle est calculee
+ *
+ * @param path      Chemin du fichier
+ * @param original  Le vote avant le systeme de votes
+ * @param system    Le systeme de votes
+ * @return  Valeur booleenne indiquant que le fichier a pu etre lu
+ */
+static bool run_queries(std::string const &path, struct vote::ballot &original,
+                        vote::analysis::system system) {
+	std::ifstream stream(path);
+	std::string   line;
+
+	if (!stream) {
+		std::cerr << "failed to open " << path << std::endl;
+		return false;
+	}
+
+	while (vote::parser::read_string(stream, line)) {
+		std::vector<i32>    withdrawn;
+		struct vote::ballot result;
+		usize               scans = original.checkpoints->scans;
+
+		if (!parse_query(original, line, withdrawn)) {
+			continue;
+		}
+
+		std::cout << "without " << line << ": ";
+
+		if (!vote::analysis::withdraw(original, system, withdrawn, result)) {
+			std::cout << "vote failed" << std::endl;
+			continue;
+		}
+
+		auto it = find_candidate(result, result.winners[0]);
+		std::cout << "c'est la glace " << it->name << " qui a gagne ("
+				  << result.round << " rounds, "
+				  << original.checkpoints->scans - scans << " recounted)"
+				  << std::endl;
+	}
+
+	return true;
+}
+
+/**
+ * Affiche le resultat d'une election par district : le gagnant de chaque
+ * district, puis les sieges de chaque glace. Le premier tour national est
+ * affiche sur la sortie d'erreur, comme les tours d'un vote.
+ *
+ * @param stream       Le flux de sortie
+ * @param candidates   Les glaces
+ * @param districts    Les districts, apres le systeme de votes
+ * @param system_name  Nom du systeme de votes
+ */
+static void
+print_districts(std::ostream                              &stream,
+                std::vector<struct vote::candidate> const &candidates,
+                std::vector<struct vote::district> const  &districts,
+                char const                                *system_name) {
+	std::vector<struct vote::candidate> sorted;
+	std::vector<usize>                  seats;
+	std::vector<usize>                  votes;
+	usize                               sum;
+
+	vote::districts::count_first_round(districts, votes);
+	vote::districts::count_seats(districts, seats);
+
+	sorted = candidates;
+	sum    = 0;
+	for (struct vote::candidate &c : sorted) {
+		c.votes = c.id < (i32)votes.size() ? votes[c.id] : 0;
+		sum += c.votes;
+	}
+
+	std::stable_sort(sorted.begin(), sorted.end(),
+	                 [](struct vote::candidate const &lhs,
+	                    struct vote::candidate const &rhs) {
+						 return lhs.votes > rhs.votes;
+					 });
+
+	std::cerr << "National round 1" << std::endl;
+	for (struct vote::candidate const &c : sorted) {
+		double frac = sum > 0 ? (double)c.votes / (double)sum : 0;
+
+		std::cerr << "(id: " << c.id << ") " << c.name << " ("
+				  << std::round(1000 * frac) / 10 << "%): " << c.votes
+				  << " votes" << std::endl;
+	}
+	std::cerr << std::endl;
+
+	for (struct vote::district const &d : districts) {
+		stream << d.name << ": ";
+
+		if (!d.success || d.ballot.winners.empty()) {
+			stream << system_name << " vote failed" << std::endl;
+			continue;
+		}
+
+		stream << "c'est la glace "
+			   << candidates[d.ballot.winners[0] - 1].name << " qui a gagne ("
+			   << vote::participant_count(d.ballot) << " participants, "
+			   << d.ballot.round << " rounds)" << std::endl;
+	}
+
+	sorted = candidates;
+	std::stable_sort(sorted.begin(), sorted.end(),
+	                 [&seats](struct vote::candidate const &lhs,
+	                          struct vote::candidate const &rhs) {
+						 return seats[lhs.id] > seats[rhs.id];
+					 });
+
+	stream << std::endl << "Seats" << std::endl;
+	for (struct vote::candidate const &c : sorted) {
+		stream << "(id: " << c.id << ") " << c.name << ": " << seats[c.id]
+			   << " seats" << std::endl;
+	}
+}
+
+/**
+ * Lit une election par district sur l'entree standard, applique le systeme
+ * de votes a chaque district et affiche le resultat
+ *
+ * @param system       Le systeme de votes
+ * @param system_name  Nom du systeme de votes
+ * @param batch        Pour le vote alternatif, voir <code>ballot.batch</code>
+ * @param rows         Indique que les blocs ont un participant par ligne
+ * @param anonymous    Indique que les noms des participants sont ignores
+ * @param jobs         Nombre de fils d'execution
+ * @return  Valeur booleenne indiquant que le vote a reussi dans tous les
+ *          districts
+ */
+static bool run_districts(vote::analysis::system system,
+                          char const *system_name, bool batch, bool rows,
+                          bool anonymous, usize jobs) {
+	enum vote::input::format            format;
+	std::unique_ptr<std::istream>       input;
+	std::vector<struct vote::candidate> candidates;
+	std::vector<struct vote::district>  districts;
+	struct vote::validation             validation;
+	bool                                success;
+
+	input = vote::input::open(std::cin, format);
+	if (!input) {
+		std::cerr << "compressed input is not supported by this build"
+				  << std::endl;
+		return false;
+	}
+
+	if (!vote::districts::parse(*input, rows, anonymous,
+	                            system != vote::algorithm::two_round, jobs,
+	                            candidates, districts, validation) &&
+	    !input->bad()) {
+		if (validation.rejected > 0) {
+			print_validation(std::cerr, validation);
+			std::cerr << "invalid data" << std::endl;
+		} else {
+			std::cerr << "failed to parse input" << std::endl;
+		}
+		return false;
+	}
+	if (input->bad()) {
+		std::cerr << "failed to decompress input" << std::endl;
+		return false;
+	}
+
+	for (struct vote::district &d : districts) {
+		d.ballot.batch = batch;
+	}
+
+	success = vote::districts::run(districts, system, jobs);
+	print_districts(std::cout, candidates, districts, system_name);
+
+	return success;
+}
+
 int main(int argc, char *const argv[]) {
 	std::string algorithm;
+	std::string cache;
+	std::string socket;
+	std::string queries;
+	std::string audit;
+
+	vote::analysis::system system;
+	char const            *system_name;
 
 	i32  vote_count;
 	bool generate;
+	bool batch;
+	bool transfers;
+	bool anonymous;
+	bool pipelined;
+	bool rows;
+	bool districts;
+	bool profiled;
+	u64  samples;
+	u64  seed;
+	u64  jobs;
+	u64  memory;
+	u64  early;
+	u64  number;
+
+	double limit;
 
 	int opt;
 
@@ -65,8 +910,23 @@ int main(int argc, char *const argv[]) {
 		return 1;
 	}
 
-	vote_count = 0;
-	generate   = false;
+	vote_count  = 0;
+	system      = nullptr;
+	system_name = "";
+	generate    = false;
+	batch       = false;
+	transfers   = false;
+	anonymous   = false;
+	pipelined   = false;
+	rows        = false;
+	districts   = false;
+	profiled    = false;
+	samples     = 0;
+	seed        = 0;
+	jobs        = 0;
+	memory      = 0;
+	early       = 0;
+	limit       = 5;
 
 	/* traitement de la ligne de commande via l'interface POSIX getopt_long */
 	while ((opt = getopt_long(argc, argv, optstring, longopts, NULL)) != -1) {
@@ -82,15 +942,79 @@ int main(int argc, char *const argv[]) {
 		case 'g':
 			generate = true;
 			break;
+		case 'b':
+			batch = true;
+			break;
+		case 't':
+			transfers = true;
+			break;
+		case 'n':
+			anonymous = true;
+			break;
+		case 'p':
+			pipelined = true;
+			break;
+		case 'r':
+			rows = true;
+			break;
+		case 'd':
+			districts = true;
+			break;
+		case 'P':
+			profiled = true;
+			break;
+		case 'k':
+			cache = optarg;
+			break;
+		case 'S':
+			socket = optarg;
+			break;
+		case 'q':
+			queries = optarg;
+			break;
+		case 'u':
+			audit = optarg;
+			break;
+		case 'l':
+			/* ecrit pour refuser aussi NaN */
+			if (!parse_real(optarg, limit) || !(limit > 0 && limit < 100)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
 		case 'c':
-			try {
-				vote_count = std::stoul(optarg);
-			} catch (std::invalid_argument const &e) {
-				std::cerr << "invalid argument: " << optarg << std::endl;
+			if (!parse_number(optarg, number)) {
 				usage(argv[0]);
 				return 1;
-			} catch (std::out_of_range const &e) {
-				std::cerr << "argument out of range: " << optarg << std::endl;
+			}
+			vote_count = number;
+			break;
+		case 'a':
+			if (!parse_number(optarg, samples) || samples == 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 's':
+			if (!parse_number(optarg, seed)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'j':
+			if (!parse_number(optarg, jobs)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'm':
+			if (!parse_number(optarg, memory) || memory == 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'e':
+			if (!parse_number(optarg, early) || early == 0) {
 				usage(argv[0]);
 				return 1;
 			}
@@ -98,78 +1022,370 @@ int main(int argc, char *const argv[]) {
 		}
 	}
 
-	/* on stocke en memoire tout ce qui est contenu dans le flux standard
-	 * d'entree en supposant qu'il redirige vers un fichier on fait cela pour
-	 * pouvoir manipuler le flux avec les methodes tellg() et seekg() de
-	 * std::basic_istream on enveloppe ce buffer dans un nouveau flux, toujours
-	 * en memoire, pour l'utiliser avec nos interfaces dans libvote */
+	if (profiled && (generate || districts || !audit.empty() ||
+	                 !socket.empty())) {
+		std::cerr << "cannot use -g, -d, -u or -S with -P" << std::endl;
+		return 1;
+	}
 
-	std::string        buffer(std::istreambuf_iterator<char>(std::cin), {});
-	std::istringstream stream(buffer);
+	/* le serveur lit les votes sur le socket et non sur l'entree standard */
+	if (!socket.empty()) {
+		if (!vote::server::serve(socket, jobs)) {
+			std::cerr << "failed to listen on " << socket << std::endl;
+			return 1;
+		}
+		return 0;
+	}
 
-	std::vector<struct vote::candidate>   candidates;
-	std::vector<struct vote::participant> participants;
+	/* l'audit lit le vote enregistre, l'entree standard donne les bulletins
+	 * papier */
+	if (!audit.empty()) {
+		return run_audit(audit, seed, limit, vote_count) ? 0 : 1;
+	}
 
-	if (!vote::parser::parse_candidates(stream, candidates, 0)) {
-		std::cerr << "failed to parse candidates" << std::endl;
+	std::vector<struct vote::candidate>       candidates;
+	struct vote::roll                         roll;
+	struct vote::first_round                  first_round;
+	std::shared_ptr<struct vote::spill const> spill;
+	struct vote::decision                     decision;
+	struct vote::memory_profile               profile;
+	struct vote::validation                   validation;
+
+	if (generate && anonymous) {
+		std::cerr << "cannot generate votes without the participants' names"
+				  << std::endl;
 		return 1;
 	}
-	if (!vote::parser::parse_participants(stream, participants, 0)) {
-		std::cerr << "failed to parse participants" << std::endl;
+	if (generate && pipelined) {
+		std::cerr << "cannot generate votes from a pipelined input"
+				  << std::endl;
+		return 1;
+	}
+	if (generate && !cache.empty()) {
+		std::cerr << "cannot cache generated votes" << std::endl;
+		return 1;
+	}
+	if (rows && (generate || pipelined || memory > 0)) {
+		std::cerr << "cannot use -g, -p or -m with one participant per line"
+				  << std::endl;
+		return 1;
+	}
+	if (early > 0 && (generate || rows || districts || !cache.empty() ||
+	                  memory > 0 || !queries.empty() || samples > 0)) {
+		std::cerr << "cannot use -g, -r, -d, -k, -m, -q or -a with -e"
+				  << std::endl;
+		return 1;
+	}
+	if (districts && (generate || pipelined || !cache.empty() || memory > 0 ||
+	                  transfers || !queries.empty() || samples > 0)) {
+		std::cerr << "cannot use -g, -p, -k, -m, -t, -q or -a with districts"
+				  << std::endl;
+		return 1;
+	}
+	if (!queries.empty() && (samples > 0 || !cache.empty())) {
+		std::cerr << "cannot use -a or -k with what-if queries" << std::endl;
+		return 1;
+	}
+	if (transfers && samples > 0) {
+		std::cerr << "cannot show transfers with -a" << std::endl;
+		return 1;
+	}
+	if (memory > 0 && (generate || samples > 0 || !cache.empty())) {
+		std::cerr << "cannot use -g, -a or -k with an out-of-core vote"
+				  << std::endl;
+		return 1;
+	}
+
+	/* il doit rester un dernier argument (le systeme de votes utilise), sauf
+	 * pour generer des votes ; il est connu avant de lire l'entree pour
+	 * verifier les classements au fur et a mesure */
+	if (!generate) {
+		if (optind == argc) {
+			std::cerr << "missing argument: ALGORITHM" << std::endl;
+			usage(argv[0]);
+			return 1;
+		} else if (optind < argc - 1) {
+			std::cerr << "too many arguments" << std::endl;
+			usage(argv[0]);
+			return 1;
+		}
+
+		algorithm = argv[optind];
+
+		if (algorithm == "two_round" || algorithm == "majoritaire") {
+			system      = vote::algorithm::two_round;
+			system_name = "two-round";
+		} else if (algorithm == "instant_runoff" || algorithm == "alternatif") {
+			system      = vote::algorithm::instant_runoff;
+			system_name = "instant-runoff";
+		} else if (algorithm == "ranked" || algorithm == "preferentiel") {
+			system      = vote::algorithm::ranked;
+			system_name = "ranked";
+		} else {
+			std::cerr << "invalid argument for ALGORITHM: " << algorithm
+					  << std::endl;
+			return 1;
+		}
+	}
+
+	roll.anonymous  = anonymous;
+	decision.total  = early;
+	decision.winner = 0;
+
+	/* l'entree standard n'est pas rembobinee si elle est lue au fur et a
+	 * mesure ou copiee d'un coup pour le cache, on peut donc la lire sans la
+	 * synchroniser avec stdio */
+	if (pipelined || rows || districts || !cache.empty() || memory > 0 ||
+	    early > 0) {
+		std::ios::sync_with_stdio(false);
+	}
+
+	/* les allocations d'avant la lecture ne dependent pas de l'entree */
+	if (profiled) {
+		vote::profile::start(profile);
+	}
+
+	/* avec le cache, l'entree n'est lue qu'apres avoir choisi le systeme de
+	 * votes, qui fait partie de l'empreinte du resultat ; les districts sont
+	 * lus avec leur propre format */
+	if (memory > 0) {
+		if (!spill_input(memory << 20, system != vote::algorithm::two_round,
+		                 candidates, spill, first_round)) {
+			return 1;
+		}
+	} else if (early > 0) {
+		if (!decide_input(candidates, roll, decision, first_round)) {
+			return 1;
+		}
+	} else if (cache.empty() && !districts &&
+	           !read_input(std::cin, false, pipelined, rows, candidates, roll,
+	                       first_round)) {
 		return 1;
 	}
 
 	if (generate) {
 		vote::generator::init();
 
-		return (int)vote::generator::generate_vote(std::cout, candidates,
-		                                           participants, vote_count);
+		return (int)vote::generator::generate_vote(std::cout, candidates, roll,
+		                                           vote_count);
 	}
 
-	/* il doit rester un dernier argument (le systeme de votes utilise) */
-	if (optind == argc) {
-		std::cerr << "missing argument: ALGORITHM" << std::endl;
-		usage(argv[0]);
-		return 1;
-	} else if (optind < argc - 1) {
-		std::cerr << "too many arguments" << std::endl;
-		usage(argv[0]);
+	/* le gagnant du premier tour l'est pour tous les systemes de votes, si
+	 * les participants lus sont valides comme ils le seraient sans -e */
+	if (decision.winner != 0) {
+		struct vote::ranks ranks;
+
+		validation.rejected = 0;
+		if (!vote::tally::get_ranks(roll, candidates.size(),
+		                            system != vote::algorithm::two_round,
+		                            ranks, validation)) {
+			print_validation(std::cerr, validation);
+			std::cerr << "invalid data" << std::endl;
+			return 1;
+		}
+		if (system == vote::algorithm::two_round && ranks.length != 2) {
+			std::cerr << system_name << " vote failed" << std::endl;
+			return 1;
+		}
+
+		if (profiled) {
+			vote::profile::mark(profile, "read");
+		}
+
+		print_decision(std::cout, candidates, decision, first_round);
+
+		if (profiled) {
+			print_profile(profile, "output", decision.counted);
+		}
+		return 0;
+	}
+
+	/* chaque district a ses propres participants */
+	if (districts) {
+		return run_districts(system, system_name, batch, rows, anonymous, jobs)
+		           ? 0
+		           : 1;
+	}
+
+	if (!queries.empty() && system == vote::algorithm::two_round) {
+		std::cerr << "what-if queries need instant_runoff or ranked"
+				  << std::endl;
 		return 1;
 	}
 
-	algorithm = argv[optind];
+	std::string        options;
+	std::string        result_path;
+	std::string        ballot_path;
+	std::ostringstream rounds;
+	std::ostringstream output;
+	std::streambuf    *errors;
+	bool               cached;
+	u64                input_key;
+	u64                result_key;
+
+	cached     = false;
+	input_key  = 0;
+	result_key = 0;
+
+	if (!cache.empty()) {
+		std::string input;
+		std::string previous_rounds;
+		std::string previous_output;
+
+		if (!read_all(std::cin, input)) {
+			std::cerr << "failed to read input" << std::endl;
+			return 1;
+		}
+
+		/* le resultat depend de l'entree et de toutes les options qui
+		 * changent l'affichage, mais pas du nombre de fils d'execution */
+		options = std::string(system_name) + " " + std::to_string(batch) +
+		          " " + std::to_string(transfers) +
+		          " " + std::to_string(samples) + " " + std::to_string(seed);
+
+		/* le meme texte ne donne pas le meme vote avec -r */
+		input_key   = vote::cache::hash(input.data(), input.size(), rows);
+		result_key  = vote::cache::hash(options.data(), options.size(),
+		                                input_key);
+		ballot_path = vote::cache::get_path(cache, input_key, "ballot");
+		result_path = vote::cache::get_path(cache, result_key, "result");
+
+		if (vote::cache::load_result(result_path, result_key, previous_rounds,
+		                             previous_output)) {
+			std::cerr << previous_rounds;
+			std::cout << previous_output;
+
+			if (profiled) {
+				print_profile(profile, "cache", 0);
+			}
+			return 0;
+		}
+
+		cached = vote::cache::load_ballot(ballot_path, input_key, candidates,
+		                                  roll);
+		if (!cached) {
+			vote::input::memory buffer(input.data(), input.size());
+			std::istream        source(&buffer);
+
+			candidates.clear();
+			roll           = {};
+			roll.anonymous = anonymous;
+
+			if (!read_input(source, true, pipelined, rows, candidates, roll,
+			                first_round)) {
+				return 1;
+			}
+		}
+	}
+
+	if (profiled) {
+		vote::profile::mark(profile, "read");
+	}
 
 	vote::ballot b;
-	if (!vote::get_ballot(candidates, participants, b)) {
+	validation.rejected = 0;
+	if (spill ? !vote::get_ballot(std::move(candidates), spill, b)
+	          : !vote::get_ballot(std::move(candidates), std::move(roll), b,
+	                              system != vote::algorithm::two_round,
+	                              validation)) {
+		if (validation.rejected > 0) {
+			print_validation(std::cerr, validation);
+		}
 		std::cerr << "invalid data" << std::endl;
 		return 1;
 	}
 
-	if (algorithm == "two_round" || algorithm == "majoritaire") {
-		if (!vote::algorithm::two_round(b)) {
-			std::cerr << "two-round vote failed" << std::endl;
+	b.batch       = batch;
+	b.first_round = std::move(first_round);
+
+	/* les requetes repartent du vote avant le systeme de votes, avec les
+	 * decomptes de ses tours */
+	vote::ballot original;
+	if (!queries.empty()) {
+		b.checkpoints = std::make_shared<struct vote::checkpoints>();
+		original      = b;
+	}
+
+	if (!cache.empty() && !cached) {
+		vote::cache::save_ballot(ballot_path, input_key, b);
+	}
+
+	if (profiled) {
+		vote::profile::mark(profile, "ballot");
+		b.observer      = vote::profile::observe_round;
+		b.observer_data = &profile;
+	}
+
+	/* les tours sont affiches sur la sortie d'erreur : on les garde pour le
+	 * cache en plus de les afficher */
+	errors = std::cerr.rdbuf();
+	if (!cache.empty()) {
+		std::cerr.rdbuf(rounds.rdbuf());
+	}
+
+	if (samples > 0) {
+		std::vector<usize> wins;
+
+		if (!vote::analysis::bootstrap(b, system, samples, seed, jobs, wins)) {
+			std::cerr.rdbuf(errors);
+			std::cerr << rounds.str();
+			std::cerr << system_name << " vote failed" << std::endl;
 			return 1;
 		}
-	} else if (algorithm == "instant_runoff" || algorithm == "alternatif") {
-		if (!vote::algorithm::instant_runoff(b)) {
-			std::cerr << "instant-runoff vote failed" << std::endl;
+
+		print_analysis(output, b, wins, samples);
+
+		if (profiled) {
+			vote::profile::mark(profile, "analysis");
+		}
+	} else {
+		bool success;
+
+		/* un vote deverse sur disque peut echouer en relisant le fichier */
+		try {
+			success = system(b);
+		} catch (std::ios_base::failure const &) {
+			std::cerr.rdbuf(errors);
+			std::cerr << "failed to read spilled ballots" << std::endl;
 			return 1;
 		}
-	} else if (algorithm == "ranked" || algorithm == "preferentiel") {
-		if (!vote::algorithm::ranked(b)) {
-			std::cerr << "ranked vote failed" << std::endl;
+
+		if (!success) {
+			std::cerr.rdbuf(errors);
+			std::cerr << rounds.str();
+			std::cerr << system_name << " vote failed" << std::endl;
 			return 1;
 		}
-	} else {
-		std::cerr << "invalid argument for ALGORITHM: " << algorithm
-				  << std::endl;
+
+		auto it = find_candidate(b, b.winners[0]);
+		assert(it != b.candidates.end());
+		output << "c'est la glace " << it->name << " qui a gagne" << std::endl;
+
+		if (transfers) {
+			print_transfers(output, b);
+		}
+	}
+
+	std::cerr.rdbuf(errors);
+	std::cerr << rounds.str();
+	std::cout << output.str();
+
+	if (profiled) {
+		vote::profile::mark(profile, "output");
+	}
+
+	if (!queries.empty() && !run_queries(queries, original, system)) {
 		return 1;
 	}
 
-	auto it = find_candidate(b, b.winners[0]);
-	assert(it != b.candidates.end());
-	std::cout << "c'est la glace " << it->name << " qui a gagne" << std::endl;
+	if (!cache.empty()) {
+		vote::cache::save_result(result_path, result_key, rounds.str(),
+		                         output.str());
+	}
+
+	if (profiled) {
+		print_profile(profile, "end", participant_count(b));
+	}
 
 	return 0;
 }
-
@@ -1,7 +1,14 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++11 thread
 CONFIG -= app_bundle qt
 SOURCES += main.cc
 INCLUDEPATH += ../libvote
 LIBS *= -L../libvote -lvote
 
+CONFIG += link_pkgconfig
+packagesExist(zlib) {
+    PKGCONFIG += zlib
+}
+packagesExist(libzstd) {
+    PKGCONFIG += libzstd
+}
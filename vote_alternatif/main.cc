@@ -11,20 +11,23 @@ int main() {
 	std::string        buffer(std::istreambuf_iterator<char>(std::cin), {});
 	std::istringstream stream(buffer);
 
-	std::vector<struct vote::candidate>   candidates;
-	std::vector<struct vote::participant> participants;
+	std::vector<struct vote::candidate> candidates;
+	struct vote::roll                   roll;
+
+	/* les noms des participants ne sont jamais affiches */
+	roll.anonymous = true;
 
 	if (!vote::parser::parse_candidates(stream, candidates, 0)) {
 		std::cerr << "failed to parse candidates" << std::endl;
 		return 1;
 	}
-	if (!vote::parser::parse_participants(stream, participants, 0)) {
+	if (!vote::parser::parse_participants(stream, roll, 0)) {
 		std::cerr << "failed to parse participants" << std::endl;
 		return 1;
 	}
 
 	vote::ballot ballot;
-	if (!vote::get_ballot(candidates, participants, ballot)) {
+	if (!vote::get_ballot(std::move(candidates), std::move(roll), ballot)) {
 		std::cerr << "invalid data" << std::endl;
 		return 1;
 	}